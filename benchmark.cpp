@@ -0,0 +1,331 @@
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <string.h>
+#include <fcntl.h>
+#include <chrono>
+#include <vector>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include "pager.h"
+#include "policy.h"
+#include "workload.h"
+using namespace std;
+
+#define DEFAULT_REPEATS 3
+#define DEFAULT_MICRO_REFERENCES 500000
+#define BENCH_SEED "42"
+#define MICRO_SLOTS 16
+#define MICRO_WRITE_PERCENT 15
+
+// Structures for one oss configuration of the benchmark matrix; every run also gets a fixed seed, quiet
+// logging and a machine-readable report
+struct SystemCase {
+    const char* name;
+    const char* args;
+};
+
+const SystemCase SYSTEM_CASES[] = {
+    {"baseline", "-n 20 -s 5"},
+    {"tight-zipf", "-n 50 -s 10 -g 128 -W zipf"},
+    {"phase-ring-batched", "-n 50 -s 10 -g 512 -W phase -b 8 -T ring"},
+    {"workers-mix", "-n 50 -s 10 -j 4 -W zipf+scan"},
+    {"inproc-tight", "-n 50 -s 10 -g 64 -E inproc"},
+    {"large-loop", "-n 50 -s 18 -g 4096,1024,256 -W loop"},
+    {"shared-image", "-n 20 -s 20 -g 512 -W zipf -H 24"},
+};
+
+// Structures for what one run of oss is measured by
+struct SystemResult {
+    int exitStatus;
+    double wallSeconds;
+    double userSeconds;
+    double systemSeconds;
+    long voluntarySwitches;
+    long involuntarySwitches;
+    double memoryAccesses;
+    double faults;
+    int processes;
+    int unfinished; // Processes still running when oss stopped, as when its alarm cut the run short
+    double p50Wall, p99Wall, p50Simulated, p99Simulated;
+};
+
+// Returns the number following "key": in a report, searching from the first occurrence of within
+// (the whole report when it is empty); 0 if it is not there
+double ReportNumber(const string& report, const char* within, const char* key){
+    size_t from = 0;
+    if(within[0] != '\0' && (from = report.find(string("\"") + within + "\"")) == string::npos){
+        return 0;
+    }
+    size_t at = report.find(string("\"") + key + "\": ", from);
+    return (at == string::npos) ? 0 : atof(report.c_str() + at + strlen(key) + 4);
+}
+
+// Returns the number of times text occurs in a report
+int ReportCount(const string& report, const char* text){
+    int count = 0;
+    for(size_t at = report.find(text); at != string::npos; at = report.find(text, at + 1)){
+        count++;
+    }
+    return count;
+}
+
+double Seconds(const struct timeval& time){
+    return time.tv_sec + time.tv_usec / 1e6;
+}
+
+// Runs oss once with a case's arguments and measures it: wall time here, CPU time and context switches
+// of oss and every user it reaped, and the rest from the report it writes to reportPrefix
+bool RunSystemCase(const SystemCase* bench, const string& reportPrefix, SystemResult* result){
+    vector<string> args = {"./oss"};
+    istringstream words(string(bench->args) + " -S " BENCH_SEED " -q -f /dev/null -o " + reportPrefix);
+    for(string word; words >> word;){
+        args.push_back(word);
+    }
+    vector<char*> argv;
+    for(string& arg : args){
+        argv.push_back(&arg[0]);
+    }
+    argv.push_back(nullptr);
+
+    struct rusage before, after;
+    getrusage(RUSAGE_CHILDREN, &before);
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    pid_t pid = fork();
+    if(pid == -1){
+        perror("Error: fork of oss failed");
+        return false;
+    }
+    if(pid == 0){
+        int devNull = open("/dev/null", O_WRONLY);
+        dup2(devNull, STDOUT_FILENO);
+        execv(argv[0], argv.data());
+        perror("Error: exec of ./oss failed");
+        _exit(127);
+    }
+    int status;
+    waitpid(pid, &status, 0);
+    std::chrono::duration<double> duration = std::chrono::steady_clock::now() - start;
+    getrusage(RUSAGE_CHILDREN, &after);
+
+    result->exitStatus = WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+    result->wallSeconds = duration.count();
+    result->userSeconds = Seconds(after.ru_utime) - Seconds(before.ru_utime);
+    result->systemSeconds = Seconds(after.ru_stime) - Seconds(before.ru_stime);
+    result->voluntarySwitches = after.ru_nvcsw - before.ru_nvcsw;
+    result->involuntarySwitches = after.ru_nivcsw - before.ru_nivcsw;
+
+    string jsonName = reportPrefix + ".json";
+    ifstream file(jsonName);
+    if(!file){
+        std::cerr << "Error: oss " << bench->args << " wrote no report (exit status " << result->exitStatus << ")" << std::endl;
+        return false;
+    }
+    stringstream text;
+    text << file.rdbuf();
+    string report = text.str();
+    unlink(jsonName.c_str());
+    unlink((reportPrefix + ".csv").c_str());
+
+    result->memoryAccesses = ReportNumber(report, "totals", "memoryAccesses");
+    result->faults = ReportNumber(report, "totals", "faults");
+    result->processes = (int)ReportNumber(report, "totals", "processes");
+    result->unfinished = ReportCount(report, "\"endedAtNs\": -1,");
+    result->p50Wall = ReportNumber(report, "wallNs", "p50");
+    result->p99Wall = ReportNumber(report, "wallNs", "p99");
+    result->p50Simulated = ReportNumber(report, "simulatedNs", "p50");
+    result->p99Simulated = ReportNumber(report, "simulatedNs", "p99");
+    return true;
+}
+
+// Clears the pager's tables and counters for a frame table of the given size under a policy
+void ResetPager(int frames, const char* policy, void** memory){
+    frameTableSize = frames;
+    free(*memory);
+    *memory = calloc(1, MemorySegmentSize(TOTAL_INSTANCES));
+    LayoutMemorySegment(*memory);
+    SetReplacementPolicy(policy);
+    for(int i = 0; i < TOTAL_INSTANCES; i++){
+        processTable[i].isOccupied = (i < MICRO_SLOTS);
+        processTable[i].pid = i + 1;
+    }
+    InitializePageTable(processTable);
+    memoryAccesses = 0;
+    pageFaults = 0;
+    pageWriteBacks = 0;
+}
+
+// Structures for a run of one pager microbenchmark
+struct MicroResult {
+    long long operations;
+    double seconds;
+};
+
+// Times HandlePageRequest on references that all hit: every page of every slot is resident first
+MicroResult BenchRequestHits(const char* policy, int references, void** memory){
+    ResetPager(MICRO_SLOTS * pagesPerProcess, policy, memory);
+    for(int slot = 0; slot < MICRO_SLOTS; slot++){
+        for(int page = 0; page < pagesPerProcess; page++){
+            HandlePageRequest(slot, page * pageSize, MSG_READ);
+        }
+    }
+    pageFaults = 0;
+    Rng rng;
+    RngSeed(&rng, 1);
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for(int r = 0; r < references; r++){
+        int slot = (int)RngBelow(&rng, MICRO_SLOTS);
+        int address = (int)RngBelow(&rng, pagesPerProcess * pageSize);
+        HandlePageRequest(slot, address, (RngBelow(&rng, 100) < MICRO_WRITE_PERCENT) ? MSG_WRITE : MSG_READ);
+    }
+    std::chrono::duration<double> duration = std::chrono::steady_clock::now() - start;
+    return {references, duration.count()};
+}
+
+// Times HandlePageRequest on uniform references to four times as many pages as there are frames
+MicroResult BenchRequestMixed(const char* policy, int references, void** memory){
+    ResetPager(MICRO_SLOTS * pagesPerProcess / 4, policy, memory);
+    Rng rng;
+    RngSeed(&rng, 2);
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for(int r = 0; r < references; r++){
+        int slot = (int)RngBelow(&rng, MICRO_SLOTS);
+        int address = (int)RngBelow(&rng, pagesPerProcess * pageSize);
+        HandlePageRequest(slot, address, (RngBelow(&rng, 100) < MICRO_WRITE_PERCENT) ? MSG_WRITE : MSG_READ);
+    }
+    std::chrono::duration<double> duration = std::chrono::steady_clock::now() - start;
+    return {references, duration.count()};
+}
+
+// Times HandlePageFault alone: a scan over four times as many pages as there are frames faults on
+// nearly every page, and the few a policy keeps resident are stepped over
+MicroResult BenchPageFaults(const char* policy, int references, void** memory){
+    ResetPager(MICRO_SLOTS * pagesPerProcess / 4, policy, memory);
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    long long faults = 0;
+    for(int r = 0; r < references; r++){
+        int slot = (r / pagesPerProcess) % MICRO_SLOTS;
+        int page = r % pagesPerProcess;
+        if(processTable[slot].pageTable[page] != -1){
+            continue;
+        }
+        HandlePageFault(slot, page, (r % 7 == 0) ? MSG_WRITE : MSG_READ);
+        faults++;
+    }
+    std::chrono::duration<double> duration = std::chrono::steady_clock::now() - start;
+    return {faults, duration.count()};
+}
+
+// Runs the oss benchmark matrix and the pager microbenchmarks, printing a summary and writing every
+// measurement to prefix-system.csv and prefix-pager.csv
+int main(int argc, char** argv){
+    int option;
+    int repeats = DEFAULT_REPEATS;
+    int references = DEFAULT_MICRO_REFERENCES;
+    string prefix = "bench";
+    bool runSystem = true, runMicro = true;
+    while ( (option = getopt(argc, argv, "hr:p:o:SM")) != -1) {
+        switch(option) {
+            case 'h':
+                printf(" [-r runsPerCase] [-p referencesPerMicrobenchmark] [-o csvPrefix]\n"
+                       " [-S (oss runs only)] [-M (pager microbenchmarks only)]\n");
+                return 0;
+            case 'r':
+                repeats = atoi(optarg);
+                break;
+            case 'p':
+                references = atoi(optarg);
+                break;
+            case 'o':
+                prefix = optarg;
+                break;
+            case 'S':
+                runMicro = false;
+                break;
+            case 'M':
+                runSystem = false;
+                break;
+        }
+    }
+    if(repeats < 1 || references < 1){
+        std::cerr << "Error: at least one run and one reference are needed" << std::endl;
+        return 1;
+    }
+
+    bool failed = false;
+    if(runSystem){
+        string csvName = prefix + "-system.csv";
+        FILE* csv = fopen(csvName.c_str(), "w");
+        if(csv == nullptr){
+            perror("Error: unable to write the system results");
+            return 1;
+        }
+        fprintf(csv, "case,run,args,exitStatus,processes,unfinished,wallSeconds,memoryAccesses,accessesPerSecond,faults,"
+                     "userCpuSeconds,systemCpuSeconds,voluntaryContextSwitches,involuntaryContextSwitches,"
+                     "p50LatencyWallNs,p99LatencyWallNs,p50LatencySimulatedNs,p99LatencySimulatedNs\n");
+        printf("%-20s %4s %10s %14s %9s %10s %10s %12s %12s\n", "case", "run", "wall s", "accesses/s", "cpu s", "vol csw",
+               "invol csw", "p50 wall ns", "p99 wall ns");
+        for(const SystemCase& bench : SYSTEM_CASES){
+            for(int run = 1; run <= repeats; run++){
+                SystemResult result;
+                if(!RunSystemCase(&bench, prefix + "-oss", &result)){
+                    failed = true;
+                    continue;
+                }
+                double perSecond = result.memoryAccesses / result.wallSeconds;
+                fprintf(csv, "%s,%d,%s,%d,%d,%d,%.6f,%.0f,%.1f,%.0f,%.6f,%.6f,%ld,%ld,%.0f,%.0f,%.0f,%.0f\n", bench.name, run,
+                        bench.args, result.exitStatus, result.processes, result.unfinished, result.wallSeconds, result.memoryAccesses,
+                        perSecond, result.faults, result.userSeconds, result.systemSeconds, result.voluntarySwitches,
+                        result.involuntarySwitches, result.p50Wall, result.p99Wall, result.p50Simulated, result.p99Simulated);
+                printf("%-20s %4d %10.3f %14.1f %9.3f %10ld %10ld %12.0f %12.0f%s\n", bench.name, run, result.wallSeconds, perSecond,
+                       result.userSeconds + result.systemSeconds, result.voluntarySwitches, result.involuntarySwitches,
+                       result.p50Wall, result.p99Wall, result.unfinished ? " (cut short)" : "");
+                failed = failed || result.exitStatus != 0;
+            }
+        }
+        fclose(csv);
+        printf("Wrote %s\n", csvName.c_str());
+    }
+
+    if(runMicro){
+        string csvName = prefix + "-pager.csv";
+        FILE* csv = fopen(csvName.c_str(), "w");
+        if(csv == nullptr){
+            perror("Error: unable to write the pager results");
+            return 1;
+        }
+        AllocateProcessTable(TOTAL_INSTANCES);
+        void* memory = nullptr;
+        fprintf(csv, "benchmark,policy,run,operations,faults,nsPerOperation\n");
+        printf("%-16s %-10s %12s %12s %14s\n", "benchmark", "policy", "operations", "faults", "ns/operation");
+        for(const char* policy : REPLACEMENT_POLICY_NAMES){
+            if(strcmp(policy, "opt") == 0){
+                continue; // Needs the future of a trace; replay measures it
+            }
+            for(int run = 1; run <= repeats; run++){
+                const char* names[] = {"request-hit", "request-mixed", "page-fault"};
+                MicroResult results[] = {BenchRequestHits(policy, references, &memory), {0, 0}, {0, 0}};
+                long long hitFaults = pageFaults;
+                results[1] = BenchRequestMixed(policy, references, &memory);
+                long long mixedFaults = pageFaults;
+                results[2] = BenchPageFaults(policy, references, &memory);
+                long long faults[] = {hitFaults, mixedFaults, results[2].operations}; // HandlePageFault leaves the totals alone
+                for(int b = 0; b < 3; b++){
+                    double perOperation = results[b].operations ? results[b].seconds * 1e9 / results[b].operations : 0.0;
+                    fprintf(csv, "%s,%s,%d,%lld,%lld,%.2f\n", names[b], policy, run, results[b].operations, faults[b], perOperation);
+                    if(run == 1){
+                        printf("%-16s %-10s %12lld %12lld %14.1f\n", names[b], policy, results[b].operations, faults[b], perOperation);
+                    }
+                }
+            }
+        }
+        free(memory);
+        fclose(csv);
+        printf("Wrote %s\n", csvName.c_str());
+    }
+    return failed ? 1 : 0;
+}
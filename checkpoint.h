@@ -0,0 +1,398 @@
+// Checkpoints of a simulation: one file holding the frame and page tables, the process table, the TLBs,
+// the replacement policy's state and the counters, plus whatever the program taking it adds of its own
+// (oss adds its clock, events, paging device and users). The file is a header followed by sections that
+// each start on a page boundary, so the memory image can be mapped straight out of it. A checkpoint is
+// written to a temporary file and renamed over the old one, so a crash never leaves half of one behind
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include <stdint.h>
+#include <string.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <string>
+#include "pager.h"
+#include "tlb.h"
+#include "policy.h"
+
+#define CHECKPOINT_MAGIC "OSSCKPT"
+#define CHECKPOINT_VERSION 3 // Version 2 added the shared image, version 3 widened the reference totals
+#define CHECKPOINT_ALIGN 4096
+#define CHECKPOINT_MAX_SECTIONS 8
+#define SECTION_MEMORY 1     // The frame table and page tables, exactly as LayoutMemorySegment lays them out
+#define SECTION_PAGER 2      // Counters, free pools and each slot's paging state
+#define SECTION_POLICY 3     // Each shard's replacement policy state
+#define SECTION_TLB 4        // Every slot's TLB, when there are TLBs
+#define SECTION_RUN 5        // oss: the configuration the run was started with
+#define SECTION_SIMULATION 6 // oss: clock, events, paging device, admission control, users and metrics
+
+// Structures for the file: the header, with the geometry and pager configuration the tables were built
+// with, and where each section lies
+struct CheckpointSection {
+    uint32_t id;
+    uint32_t reserved;
+    uint64_t offset;
+    uint64_t size;
+};
+
+struct CheckpointHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t sectionCount;
+    int32_t frames;
+    int32_t pageSize;
+    int32_t pagesPerProcess;
+    int32_t sharedPages;
+    int32_t slots;
+    int32_t shards;
+    char policy[16];
+    int32_t prefetchMode;
+    int32_t prefetchPages;
+    int32_t tlbEntries;
+    int32_t tlbWays;
+    int32_t tlbReplacement;
+    int32_t freeLowWatermark;
+    int32_t freeHighWatermark;
+    int64_t time; // Simulated ns when it was taken
+    CheckpointSection sections[CHECKPOINT_MAX_SECTIONS];
+};
+
+// Structures for a checkpoint being written; the sections point at data that must outlive the write
+struct CheckpointWriter {
+    CheckpointHeader header;
+    const void* data[CHECKPOINT_MAX_SECTIONS];
+};
+
+// Structures for a checkpoint mapped for reading
+struct Checkpoint {
+    void* map;
+    size_t size;
+    const CheckpointHeader* header;
+};
+
+inline uint64_t CheckpointAlign(uint64_t offset){
+    return (offset + CHECKPOINT_ALIGN - 1) & ~(uint64_t)(CHECKPOINT_ALIGN - 1);
+}
+
+// Starts a checkpoint of the pager as it is configured now, taken at the given simulated time
+inline void CheckpointBegin(CheckpointWriter* writer, long long time){
+    CheckpointHeader* header = &writer->header;
+    memset(header, 0, sizeof(*header));
+    memcpy(header->magic, CHECKPOINT_MAGIC, sizeof(header->magic));
+    header->version = CHECKPOINT_VERSION;
+    header->frames = frameTableSize;
+    header->pageSize = pageSize;
+    header->pagesPerProcess = pagesPerProcess;
+    header->sharedPages = sharedPages;
+    header->slots = processTableSize;
+    header->shards = frameShardCount;
+    snprintf(header->policy, sizeof(header->policy), "%s", frameShards[0].policy->Name());
+    header->prefetchMode = prefetchMode;
+    header->prefetchPages = prefetchPages;
+    header->tlbEntries = tlbEntries;
+    header->tlbWays = tlbWays;
+    header->tlbReplacement = tlbReplacement;
+    header->freeLowWatermark = freeLowWatermark;
+    header->freeHighWatermark = freeHighWatermark;
+    header->time = time;
+}
+
+inline void CheckpointAddSection(CheckpointWriter* writer, uint32_t id, const void* data, size_t size){
+    CheckpointHeader* header = &writer->header;
+    CheckpointSection* section = &header->sections[header->sectionCount];
+    section->id = id;
+    section->size = size;
+    section->offset = CheckpointAlign((header->sectionCount == 0) ? sizeof(CheckpointHeader)
+                                      : section[-1].offset + section[-1].size);
+    writer->data[header->sectionCount++] = data;
+}
+
+// Writes all of a buffer at an offset; returns false on an I/O error
+inline bool CheckpointWriteAt(int fd, const void* data, size_t size, uint64_t offset){
+    const char* bytes = (const char*)data;
+    while(size > 0){
+        ssize_t written = pwrite(fd, bytes, size, (off_t)offset);
+        if(written <= 0){
+            return false;
+        }
+        bytes += written;
+        size -= written;
+        offset += written;
+    }
+    return true;
+}
+
+// Writes the checkpoint to path.tmp and renames it over path; returns false, leaving path as it was, on error
+inline bool CheckpointWrite(const CheckpointWriter* writer, const char* path){
+    const CheckpointHeader* header = &writer->header;
+    std::string temporary = std::string(path) + ".tmp";
+    int fd = open(temporary.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if(fd == -1){
+        return false;
+    }
+    bool written = CheckpointWriteAt(fd, header, sizeof(*header), 0);
+    uint64_t end = sizeof(*header);
+    for(uint32_t s = 0; written && s < header->sectionCount; s++){
+        written = CheckpointWriteAt(fd, writer->data[s], header->sections[s].size, header->sections[s].offset);
+        end = header->sections[s].offset + header->sections[s].size;
+    }
+    // Padded to a whole page so the last section can be mapped like the others
+    written = written && ftruncate(fd, (off_t)CheckpointAlign(end)) == 0;
+    if(close(fd) != 0 || !written){
+        unlink(temporary.c_str());
+        return false;
+    }
+    return rename(temporary.c_str(), path) == 0;
+}
+
+// Maps a checkpoint and checks its header and section table; returns false if it is not a usable one
+inline bool CheckpointOpen(Checkpoint* checkpoint, const char* path){
+    checkpoint->map = nullptr;
+    int fd = open(path, O_RDONLY);
+    if(fd == -1){
+        return false;
+    }
+    struct stat info;
+    if(fstat(fd, &info) != 0 || (size_t)info.st_size < sizeof(CheckpointHeader)){
+        close(fd);
+        return false;
+    }
+    checkpoint->size = (size_t)info.st_size;
+    checkpoint->map = mmap(nullptr, checkpoint->size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(checkpoint->map == MAP_FAILED){
+        checkpoint->map = nullptr;
+        return false;
+    }
+    const CheckpointHeader* header = (const CheckpointHeader*)checkpoint->map;
+    checkpoint->header = header;
+    bool valid = memcmp(header->magic, CHECKPOINT_MAGIC, sizeof(header->magic)) == 0 && header->version == CHECKPOINT_VERSION
+                 && header->sectionCount <= CHECKPOINT_MAX_SECTIONS && header->frames > 0 && header->slots > 0
+                 && header->shards > 0 && header->shards <= MAX_FRAME_SHARDS && header->policy[sizeof(header->policy) - 1] == '\0';
+    for(uint32_t s = 0; valid && s < header->sectionCount; s++){
+        const CheckpointSection* section = &header->sections[s];
+        valid = section->offset <= checkpoint->size && section->size <= checkpoint->size - section->offset;
+    }
+    if(!valid){
+        munmap(checkpoint->map, checkpoint->size);
+        checkpoint->map = nullptr;
+    }
+    return valid;
+}
+
+inline void CheckpointClose(Checkpoint* checkpoint){
+    if(checkpoint->map != nullptr){
+        munmap(checkpoint->map, checkpoint->size);
+        checkpoint->map = nullptr;
+    }
+}
+
+// Returns a section's bytes and sets size, or returns nullptr if the checkpoint has no such section
+inline const void* CheckpointSectionData(const Checkpoint* checkpoint, uint32_t id, size_t* size){
+    const CheckpointHeader* header = checkpoint->header;
+    for(uint32_t s = 0; s < header->sectionCount; s++){
+        if(header->sections[s].id == id){
+            *size = header->sections[s].size;
+            return (const char*)checkpoint->map + header->sections[s].offset;
+        }
+    }
+    return nullptr;
+}
+
+// Returns how many frames held a page when the checkpoint was taken
+inline int CheckpointResidentFrames(const Checkpoint* checkpoint){
+    size_t size;
+    const uint64_t* resident = (const uint64_t*)CheckpointSectionData(checkpoint, SECTION_MEMORY, &size);
+    size_t words = (checkpoint->header->frames + FRAME_WORD_BITS - 1) / FRAME_WORD_BITS;
+    if(resident == nullptr || size < words * sizeof(uint64_t)){
+        return 0;
+    }
+    int frames = 0;
+    for(size_t w = 0; w < words; w++){
+        frames += __builtin_popcountll(resident[w]);
+    }
+    return frames;
+}
+
+// Saves what the pager keeps outside the memory segment: counters, free pools and each slot's paging state
+inline void SavePagerState(StateWriter* out){
+    long long totals[] = {memoryAccesses, pageFaults, pageWriteBacks};
+    int counters[] = {poolFaults, synchronousEvictions, backgroundWriteBacks, prefetchedPages, prefetchHits, prefetchWaste,
+                      sharedPageMappings, copyOnWriteFaults, copyOnWriteCopies, peakResidentFrames};
+    out->PutArray(totals, sizeof(totals) / sizeof(totals[0]));
+    out->PutArray(counters, sizeof(counters) / sizeof(counters[0]));
+    out->Put(tlbHits.load());
+    out->Put(tlbMisses.load());
+    for(int s = 0; s < frameShardCount; s++){
+        out->Put(frameShards[s].freeFrameCount);
+    }
+    out->PutArray(freeFrames, frameTableSize);
+    for(int i = 0; i < processTableSize; i++){
+        const ProcessControlBlock* pcb = &processTable[i];
+        out->Put(pcb->isOccupied);
+        out->Put(pcb->pid);
+        out->Put(pcb->startTime);
+        out->Put(pcb->blocked);
+        out->Put(pcb->blockedUntil);
+        out->Put(pcb->nextSlot);
+        out->Put(pcb->prevSlot);
+        out->Put(pcb->readAheadNext);
+        out->Put(pcb->readAheadWindow);
+        out->Put(pcb->suspended);
+        out->Put(processWriteBacks[i].load());
+    }
+}
+
+inline bool LoadPagerState(StateReader* in, int slots){
+    long long totals[3];
+    int counters[10];
+    long long hits, misses;
+    if(!in->GetArray(totals, 3) || !in->GetArray(counters, 10) || !in->Get(&hits) || !in->Get(&misses)){
+        return false;
+    }
+    memoryAccesses = totals[0];
+    pageFaults = totals[1];
+    pageWriteBacks = totals[2];
+    std::atomic<int>* targets[] = {&poolFaults, &synchronousEvictions, &backgroundWriteBacks, &prefetchedPages, &prefetchHits,
+                                   &prefetchWaste, &sharedPageMappings, &copyOnWriteFaults, &copyOnWriteCopies, &peakResidentFrames};
+    for(int c = 0; c < 10; c++){
+        targets[c]->store(counters[c]);
+    }
+    tlbHits = hits;
+    tlbMisses = misses;
+    for(int s = 0; s < frameShardCount; s++){
+        int count;
+        if(!in->Get(&count) || count < 0 || count > frameShards[s].frameCount){
+            return false;
+        }
+        frameShards[s].freeFrameCount = count;
+    }
+    if(!in->GetArray(freeFrames, frameTableSize)){
+        return false;
+    }
+    // A stale or damaged file can pass the header checks; every free frame has to be an empty one of its shard
+    for(int s = 0; s < frameShardCount; s++){
+        const FrameShard* shard = &frameShards[s];
+        for(int f = shard->firstFrame; f < shard->firstFrame + shard->freeFrameCount; f++){
+            int frame = freeFrames[f];
+            if(frame < shard->firstFrame || frame >= shard->firstFrame + shard->frameCount ||
+               TestFrameBit(frameTable.residentBits, frame)){
+                return false;
+            }
+        }
+    }
+    for(int i = 0; i < slots; i++){
+        ProcessControlBlock* pcb = &processTable[i];
+        int writeBacks;
+        if(!(in->Get(&pcb->isOccupied) && in->Get(&pcb->pid) && in->Get(&pcb->startTime) && in->Get(&pcb->blocked) &&
+             in->Get(&pcb->blockedUntil) && in->Get(&pcb->nextSlot) && in->Get(&pcb->prevSlot) && in->Get(&pcb->readAheadNext) &&
+             in->Get(&pcb->readAheadWindow) && in->Get(&pcb->suspended) && in->Get(&writeBacks))){
+            return false;
+        }
+        if(pcb->nextSlot < -1 || pcb->nextSlot >= slots || pcb->prevSlot < -1 || pcb->prevSlot >= slots){
+            return false;
+        }
+        processWriteBacks[i] = writeBacks;
+    }
+    return true;
+}
+
+// Saves every slot's TLB entries and replacement state
+inline void SaveTlbState(StateWriter* out){
+    for(int i = 0; i < processTableSize; i++){
+        out->PutArray(tlbs[i].pages, tlbEntries);
+        out->PutArray(tlbs[i].frames, tlbEntries);
+        out->PutArray(tlbs[i].stamps, tlbEntries);
+        out->Put(tlbs[i].clock);
+        out->Put(tlbs[i].random);
+    }
+}
+
+inline bool LoadTlbState(StateReader* in, int slots){
+    for(int i = 0; i < slots; i++){
+        if(!(in->GetArray(tlbs[i].pages, tlbEntries) && in->GetArray(tlbs[i].frames, tlbEntries) &&
+             in->GetArray(tlbs[i].stamps, tlbEntries) && in->Get(&tlbs[i].clock) && in->Get(&tlbs[i].random))){
+            return false;
+        }
+    }
+    return true;
+}
+
+// Builds the pager's sections into the given buffers and adds them, with the memory image, to a checkpoint
+inline void CheckpointAddPager(CheckpointWriter* writer, StateWriter* pager, StateWriter* policies, StateWriter* tlb){
+    SavePagerState(pager);
+    for(int s = 0; s < frameShardCount; s++){
+        frameShards[s].policy->SaveState(policies);
+    }
+    CheckpointAddSection(writer, SECTION_MEMORY, frameTable.residentBits, MemorySegmentSize(processTableSize));
+    CheckpointAddSection(writer, SECTION_PAGER, pager->bytes.data(), pager->bytes.size());
+    CheckpointAddSection(writer, SECTION_POLICY, policies->bytes.data(), policies->bytes.size());
+    if(tlbEntries > 0){
+        SaveTlbState(tlb);
+        CheckpointAddSection(writer, SECTION_TLB, tlb->bytes.data(), tlb->bytes.size());
+    }
+}
+
+// Tells a freshly reset policy about every page already resident in its shard, lowest frame first, as
+// though they had just been faulted in; used when the checkpoint was taken under another policy
+inline void WarmReplacementPolicy(FrameShard* shard){
+    optNextUse = OPT_NEVER;
+    for(int frame = shard->firstFrame; frame < shard->firstFrame + shard->frameCount; frame++){
+        if(TestFrameBit(frameTable.residentBits, frame)){
+            shard->policy->OnInsert(frame - shard->firstFrame);
+        }
+    }
+}
+
+// Restores the pager from a checkpoint into tables already laid out for its geometry and shard count,
+// with at least its number of slots; slots beyond those it has are left empty. Policy state is taken if
+// the policy in use is the one that saved it, and TLBs if they are configured the same way; otherwise the
+// policy is warmed with the resident pages and the TLBs start empty. Returns false if it does not fit
+inline bool RestorePager(const Checkpoint* checkpoint){
+    const CheckpointHeader* header = checkpoint->header;
+    if(header->frames != frameTableSize || header->pageSize != pageSize || header->pagesPerProcess != pagesPerProcess
+       || header->sharedPages != sharedPages || header->slots > processTableSize || header->shards != frameShardCount){
+        return false;
+    }
+    size_t size;
+    const void* memory = CheckpointSectionData(checkpoint, SECTION_MEMORY, &size);
+    if(memory == nullptr || size != MemorySegmentSize(header->slots)){
+        return false;
+    }
+    memcpy(frameTable.residentBits, memory, size);
+
+    size = 0;
+    const void* pager = CheckpointSectionData(checkpoint, SECTION_PAGER, &size);
+    StateReader pagerState(pager, size);
+    if(pager == nullptr || !LoadPagerState(&pagerState, header->slots)){
+        return false;
+    }
+
+    size = 0;
+    const void* policies = CheckpointSectionData(checkpoint, SECTION_POLICY, &size);
+    StateReader policyState(policies, size);
+    bool samePolicy = policies != nullptr && strcmp(header->policy, frameShards[0].policy->Name()) == 0;
+    for(int s = 0; s < frameShardCount; s++){
+        if(!samePolicy || !frameShards[s].policy->LoadState(&policyState)){
+            frameShards[s].policy->Reset(frameShards[s].frameCount);
+            WarmReplacementPolicy(&frameShards[s]);
+        }
+    }
+
+    for(int i = 0; i < processTableSize; i++){
+        TlbFlush(i);
+    }
+    const void* tlb = CheckpointSectionData(checkpoint, SECTION_TLB, &size);
+    if(tlb != nullptr && header->tlbEntries == tlbEntries && header->tlbWays == tlbWays && header->tlbReplacement == tlbReplacement){
+        StateReader tlbState(tlb, size);
+        if(!LoadTlbState(&tlbState, header->slots)){
+            return false;
+        }
+    }
+    return true;
+}
+
+#endif
@@ -0,0 +1,117 @@
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <iostream>
+#include <string.h>
+#include <chrono>
+#include <random>
+#include <vector>
+#include "pager.h"
+#include "policy.h"
+using namespace std;
+
+#define HITS_PER_EVICTION 4 // Random references between victim searches in the steady workload
+
+// The clock hand as it was before ClockSweep: one frame per step
+int ClockSweepByFrame(const uint64_t* residentBits, uint64_t* referenceBits, int frames, int* hand){
+    while(true){
+        int frame = *hand;
+        *hand = (*hand + 1 == frames) ? 0 : *hand + 1;
+        if(!TestFrameBit(residentBits, frame)){
+            continue;
+        }
+        if(!TestFrameBit(referenceBits, frame)){
+            return frame;
+        }
+        ClearFrameBit(referenceBits, frame);
+    }
+}
+
+typedef int (*SweepFunction)(const uint64_t*, uint64_t*, int, int*);
+
+// Structures for one run of a sweep kernel over a workload
+struct SweepRun {
+    vector<int> victims;
+    vector<uint64_t> referenceBits; // Left behind by the last search
+    double seconds;                 // Spent inside the kernel only
+};
+
+// Runs searches victim searches. The saturated workload sets every reference bit before each search, so
+// the hand sweeps the whole table; the steady one re-references each victim (it was just refilled) and
+// a few random frames. Every frame is resident, except every 7th in the steady workload
+SweepRun RunSweeps(SweepFunction sweep, int frames, int searches, bool saturated){
+    int words = (frames + FRAME_WORD_BITS - 1) / FRAME_WORD_BITS;
+    vector<uint64_t> resident(words, 0);
+    SweepRun run;
+    run.referenceBits.assign(words, 0);
+    for(int frame = 0; frame < frames; frame++){
+        if(saturated || frame % 7 != 0){
+            SetFrameBit(resident.data(), frame);
+            SetFrameBit(run.referenceBits.data(), frame);
+        }
+    }
+    std::mt19937_64 generator(frames);
+    std::uniform_int_distribution<int> anyFrame(0, frames - 1);
+    int hand = 0;
+    run.seconds = 0;
+    run.victims.reserve(searches);
+    for(int s = 0; s < searches; s++){
+        if(saturated){
+            memcpy(run.referenceBits.data(), resident.data(), words * sizeof(uint64_t));
+        }
+        std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+        int victim = sweep(resident.data(), run.referenceBits.data(), frames, &hand);
+        std::chrono::duration<double> duration = std::chrono::high_resolution_clock::now() - start;
+        run.seconds += duration.count();
+        run.victims.push_back(victim);
+        if(!saturated){
+            SetFrameBit(run.referenceBits.data(), victim);
+            for(int h = 0; h < HITS_PER_EVICTION; h++){
+                int frame = anyFrame(generator);
+                if(TestFrameBit(resident.data(), frame)){
+                    SetFrameBit(run.referenceBits.data(), frame);
+                }
+            }
+        }
+    }
+    return run;
+}
+
+// Times the per-frame and word-at-a-time clock sweeps on the same workloads and checks that they
+// choose the same victims and leave the same reference bits
+int main(int argc, char** argv){
+    int option;
+    int searches = 2000;
+    while ( (option = getopt(argc, argv, "hn:")) != -1) {
+        switch(option) {
+            case 'h':
+                printf(" [-n victimSearchesPerRun]\n");
+                return 0;
+            case 'n':
+                searches = atoi(optarg);
+                break;
+        }
+    }
+    if(searches < 1){
+        std::cerr << "Error: at least one search per run is needed" << std::endl;
+        return 1;
+    }
+
+    const int sizes[] = {256, 65536, 16777216};
+    printf("%-10s %-10s %16s %16s %8s %8s\n", "frames", "workload", "per-frame ns", "per-word ns", "speedup", "match");
+    bool allMatch = true;
+    for(int frames : sizes){
+        for(int saturated = 1; saturated >= 0; saturated--){
+            // Whole-table sweeps of the largest table take long enough per frame that fewer are needed
+            int runSearches = (saturated && frames > 65536) ? (searches + 99) / 100 : searches;
+            SweepRun byFrame = RunSweeps(ClockSweepByFrame, frames, runSearches, saturated);
+            SweepRun byWord = RunSweeps(ClockSweep, frames, runSearches, saturated);
+            bool match = byFrame.victims == byWord.victims && byFrame.referenceBits == byWord.referenceBits;
+            allMatch = allMatch && match;
+            printf("%-10d %-10s %16.1f %16.1f %7.1fx %8s\n", frames, saturated ? "saturated" : "steady",
+                   byFrame.seconds * 1e9 / runSearches, byWord.seconds * 1e9 / runSearches,
+                   byFrame.seconds / byWord.seconds, match ? "yes" : "NO");
+        }
+    }
+    return allMatch ? 0 : 1;
+}
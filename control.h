@@ -0,0 +1,153 @@
+// Control segment shared by oss and its users: the simulated clock, and a page of counters per process
+// table slot that each user keeps about itself. Both are read and written with plain atomic loads and
+// stores, so a user never has to ask oss for the time and never has to report its counters
+#ifndef CONTROL_H
+#define CONTROL_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <chrono>
+#include <atomic>
+#include "transport.h"
+
+#define CONTROL_PROJ_ID 35
+#define NANOSECONDS_PER_SECOND 1000000000LL
+
+// Structures for the simulated clock: 64-bit nanoseconds published under a sequence lock. A writer makes
+// the sequence odd while it stores the time and even again afterwards; a reader retries if it saw an odd
+// sequence or the sequence moved while it read, so it always sees one whole time. A reader spins for as
+// long as a store is in progress, so a writer descheduled in the middle of one holds up every user
+struct SharedClock {
+    std::atomic<uint32_t> sequence;
+    std::atomic<uint64_t> nanoseconds;
+};
+
+// Structures for the counters a user keeps about itself; each slot has its own cache line, so users
+// updating their counters never contend. Only the slot's user writes them while it runs
+struct alignas(64) SlotStats {
+    std::atomic<int32_t> pid;             // User the counters belong to, 0 before one is launched
+    std::atomic<uint64_t> requests;       // Batches sent
+    std::atomic<uint64_t> references;     // References generated, each counted once however often it is resent
+    std::atomic<uint64_t> writes;         // Of which writes
+    std::atomic<uint64_t> blockedReplies; // Replies that stopped at a page fault
+    std::atomic<uint64_t> waitTime;       // Wall-clock ns spent waiting for replies
+};
+
+// Structures for what a user relaunched from a checkpoint (oss -k) takes over from the one it replaces:
+// oss fills its slot's entry before starting it
+struct SlotResume {
+    uint64_t generated;  // References the user had generated; the new one regenerates and discards them
+    int32_t outstanding; // Its batch had been sent and the reply is still to come
+    int32_t counted;     // Its next batch was already counted in SlotStats by the user it replaces
+    MessageBuffer batch; // The references it had generated but not had granted yet
+};
+
+// Structures for the segment: the clock on its own cache line, followed by one SlotStats per slot and
+// then one SlotResume per slot
+struct ControlSegment {
+    alignas(64) SharedClock clock;
+    int32_t slotCount;
+};
+
+inline size_t ControlSegmentSize(int slots){
+    return sizeof(ControlSegment) + slots * (sizeof(SlotStats) + sizeof(SlotResume));
+}
+
+inline SlotStats* ControlSlotStats(ControlSegment* control, int slot){
+    return reinterpret_cast<SlotStats*>(control + 1) + slot;
+}
+
+inline SlotResume* ControlSlotResume(ControlSegment* control, int slot){
+    return reinterpret_cast<SlotResume*>(ControlSlotStats(control, control->slotCount)) + slot;
+}
+
+// Publishes a clock value unless the clock is already at or past it. Writers claim the sequence with a
+// compare-and-swap from even to odd, so oss's worker threads never interleave their stores
+inline void ClockPublish(SharedClock* clock, uint64_t time){
+    uint32_t sequence = clock->sequence.load(std::memory_order_relaxed);
+    while(true){
+        if(sequence & 1){
+            sequence = clock->sequence.load(std::memory_order_relaxed);
+            continue;
+        }
+        if(clock->sequence.compare_exchange_weak(sequence, sequence + 1, std::memory_order_acquire, std::memory_order_relaxed)){
+            break;
+        }
+    }
+    std::atomic_thread_fence(std::memory_order_release);
+    if(time > clock->nanoseconds.load(std::memory_order_relaxed)){
+        clock->nanoseconds.store(time, std::memory_order_relaxed);
+    }
+    clock->sequence.store(sequence + 2, std::memory_order_release);
+}
+
+// Returns the published clock as nanoseconds, retrying until it reads it outside a writer's store
+inline uint64_t ClockRead(const SharedClock* clock){
+    while(true){
+        uint32_t before = clock->sequence.load(std::memory_order_acquire);
+        if(before & 1){
+            continue;
+        }
+        uint64_t time = clock->nanoseconds.load(std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if(clock->sequence.load(std::memory_order_relaxed) == before){
+            return time;
+        }
+    }
+}
+
+// Splits a clock value into the seconds and nanoseconds shown in logs
+inline int TimeSeconds(long long time){
+    return (int)(time / NANOSECONDS_PER_SECOND);
+}
+
+inline int TimeNanoseconds(long long time){
+    return (int)(time % NANOSECONDS_PER_SECOND);
+}
+
+// Adds to a counter of the caller's own slot; with a single writer a load and a store suffice
+inline void SlotStatsAdd(std::atomic<uint64_t>* counter, uint64_t amount){
+    counter->store(counter->load(std::memory_order_relaxed) + amount, std::memory_order_relaxed);
+}
+
+// Clears a slot's counters for the user about to be launched into it
+inline void ResetSlotStats(SlotStats* stats, pid_t pid){
+    stats->pid.store(pid, std::memory_order_relaxed);
+    stats->requests.store(0, std::memory_order_relaxed);
+    stats->references.store(0, std::memory_order_relaxed);
+    stats->writes.store(0, std::memory_order_relaxed);
+    stats->blockedReplies.store(0, std::memory_order_relaxed);
+    stats->waitTime.store(0, std::memory_order_relaxed);
+}
+
+// Starts the clock at 0 and clears every slot's counters
+inline void InitializeControlSegment(ControlSegment* control, int slots){
+    control->clock.sequence.store(0, std::memory_order_relaxed);
+    control->clock.nanoseconds.store(0, std::memory_order_relaxed);
+    control->slotCount = slots;
+    for(int i = 0; i < slots; i++){
+        ResetSlotStats(ControlSlotStats(control, i), 0);
+    }
+}
+
+// Counts a batch as it is sent; references from carried on were counted when they were generated
+inline void NoteBatchSent(SlotStats* stats, const MessageBuffer* buf, int carried){
+    int writes = 0;
+    for(int r = carried; r < buf->count; r++){
+        writes += (buf->references[r].msgCode == MSG_WRITE);
+    }
+    SlotStatsAdd(&stats->requests, 1);
+    SlotStatsAdd(&stats->references, buf->count - carried);
+    SlotStatsAdd(&stats->writes, writes);
+}
+
+// Counts a reply that arrived after waiting since sentAt
+inline void NoteReplyReceived(SlotStats* stats, const MessageBuffer* reply, std::chrono::steady_clock::time_point sentAt){
+    std::chrono::nanoseconds waited = std::chrono::steady_clock::now() - sentAt;
+    if(reply->msgCode == MSG_BLOCKED){
+        SlotStatsAdd(&stats->blockedReplies, 1);
+    }
+    SlotStatsAdd(&stats->waitTime, waited.count());
+}
+
+#endif
@@ -0,0 +1,249 @@
+// Asynchronous buffered logger: producers format records into a lock-free ring and a background
+// thread writes them to the log file and the console in batches
+#ifndef LOGGER_H
+#define LOGGER_H
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <signal.h>
+#include <pthread.h>
+#include <atomic>
+#include <thread>
+
+// Log levels, from always shown to most verbose
+#define LOG_ERROR 0
+#define LOG_INFO 1
+#define LOG_DEBUG 2
+
+// Log categories, selectable with oss -C
+#define LOG_CAT_GENERAL 0x01
+#define LOG_CAT_LAUNCH 0x02
+#define LOG_CAT_REQUEST 0x04
+#define LOG_CAT_FAULT 0x08
+#define LOG_CAT_TABLE 0x10
+#define LOG_CAT_REPORT 0x20
+#define LOG_CAT_ALL 0xFF
+
+#define LOG_RECORD_SIZE 248         // Bytes of text per record; longer messages are truncated
+#define LOG_RING_RECORDS 8192       // Must be a power of two
+#define LOG_WRITE_BUFFER 65536      // Bytes gathered before a write() to either destination
+#define LOG_IDLE_SLEEP_NS 1000000   // How long the writer naps when the ring is empty
+
+// Structures for one preformatted log record
+struct LogRecord {
+    std::atomic<uint32_t> sequence; // Vyukov bounded queue turn counter
+    uint32_t length;
+    char text[LOG_RECORD_SIZE];
+};
+
+// Structures for the logger's state
+struct Logger {
+    LogRecord records[LOG_RING_RECORDS];
+    alignas(64) std::atomic<uint32_t> enqueuePos;
+    alignas(64) uint32_t dequeuePos;
+    std::atomic<bool> running;
+    int level;
+    int categories;
+    int fileFd;
+    bool console;
+    std::thread writer;
+    char fileBuffer[LOG_WRITE_BUFFER];
+    char consoleBuffer[LOG_WRITE_BUFFER];
+    size_t fileUsed;
+    size_t consoleUsed;
+};
+
+inline Logger* logger = nullptr;
+
+// Returns true if a message of this level and category would be written; the final report ignores the level
+inline bool LogEnabled(int level, int category){
+    return logger != nullptr && (level <= logger->level || category == LOG_CAT_REPORT) &&
+           (level == LOG_ERROR || (logger->categories & category));
+}
+
+// Writes a whole buffer to a descriptor, retrying short writes
+inline void LogWriteAll(int fd, const char* data, size_t length){
+    while(length > 0){
+        ssize_t written = write(fd, data, length);
+        if(written <= 0){
+            return;
+        }
+        data += written;
+        length -= written;
+    }
+}
+
+// Flushes the writer thread's batches to the log file and the console
+inline void LogFlushBuffers(){
+    if(logger->fileUsed > 0){
+        LogWriteAll(logger->fileFd, logger->fileBuffer, logger->fileUsed);
+        logger->fileUsed = 0;
+    }
+    if(logger->consoleUsed > 0){
+        LogWriteAll(STDOUT_FILENO, logger->consoleBuffer, logger->consoleUsed);
+        logger->consoleUsed = 0;
+    }
+}
+
+// Appends one record's text to a destination batch, flushing first if it would not fit
+inline void LogAppend(char* buffer, size_t* used, const char* text, size_t length){
+    if(*used + length > LOG_WRITE_BUFFER){
+        LogFlushBuffers();
+    }
+    memcpy(buffer + *used, text, length);
+    *used += length;
+}
+
+// Moves every published record into the write batches; returns the number drained
+inline int LogDrain(){
+    int drained = 0;
+    while(true){
+        LogRecord* record = &logger->records[logger->dequeuePos & (LOG_RING_RECORDS - 1)];
+        if(record->sequence.load(std::memory_order_acquire) != logger->dequeuePos + 1){
+            break;
+        }
+        if(logger->fileFd != -1){
+            LogAppend(logger->fileBuffer, &logger->fileUsed, record->text, record->length);
+        }
+        if(logger->console){
+            LogAppend(logger->consoleBuffer, &logger->consoleUsed, record->text, record->length);
+        }
+        record->sequence.store(logger->dequeuePos + LOG_RING_RECORDS, std::memory_order_release);
+        logger->dequeuePos++;
+        drained++;
+    }
+    return drained;
+}
+
+// Body of the background writer thread
+inline void LogWriterLoop(){
+    while(logger->running.load(std::memory_order_acquire)){
+        if(LogDrain() == 0){
+            LogFlushBuffers();
+            struct timespec nap = {0, LOG_IDLE_SLEEP_NS};
+            nanosleep(&nap, nullptr);
+        }
+    }
+    LogDrain();
+    LogFlushBuffers();
+}
+
+// Opens the log file and starts the writer thread with signals blocked; returns false if the file cannot be opened
+inline bool LogInit(const char* fileName, int level, int categories, bool console){
+    logger = new Logger();
+    for(uint32_t i = 0; i < LOG_RING_RECORDS; i++){
+        logger->records[i].sequence.store(i, std::memory_order_relaxed);
+    }
+    logger->enqueuePos.store(0);
+    logger->dequeuePos = 0;
+    logger->level = level;
+    logger->categories = categories;
+    logger->console = console;
+    logger->fileUsed = 0;
+    logger->consoleUsed = 0;
+    logger->fileFd = (fileName != nullptr) ? open(fileName, O_WRONLY | O_CREAT | O_TRUNC, 0644) : -1;
+    if(fileName != nullptr && logger->fileFd == -1){
+        delete logger;
+        logger = nullptr;
+        return false;
+    }
+    // The writer starts with every signal blocked so that the program's handlers run on its own threads
+    sigset_t mask, previous;
+    sigfillset(&mask);
+    pthread_sigmask(SIG_BLOCK, &mask, &previous);
+    logger->running.store(true);
+    logger->writer = std::thread(LogWriterLoop);
+    pthread_sigmask(SIG_SETMASK, &previous, nullptr);
+    return true;
+}
+
+// Formats a message into the next free record; safe to call from any thread
+inline void LogPrintf(int level, int category, const char* format, ...) __attribute__((format(printf, 3, 4)));
+inline void LogPrintf(int level, int category, const char* format, ...){
+    if(!LogEnabled(level, category)){
+        return;
+    }
+
+    // Claim a record, waiting for the writer if the ring is full
+    LogRecord* record;
+    uint32_t pos = logger->enqueuePos.load(std::memory_order_relaxed);
+    while(true){
+        record = &logger->records[pos & (LOG_RING_RECORDS - 1)];
+        int32_t diff = (int32_t)(record->sequence.load(std::memory_order_acquire) - pos);
+        if(diff == 0){
+            if(logger->enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)){
+                break;
+            }
+        } else if(diff < 0){
+            std::this_thread::yield();
+            pos = logger->enqueuePos.load(std::memory_order_relaxed);
+        } else {
+            pos = logger->enqueuePos.load(std::memory_order_relaxed);
+        }
+    }
+
+    va_list args;
+    va_start(args, format);
+    int length = vsnprintf(record->text, LOG_RECORD_SIZE, format, args);
+    va_end(args);
+    if(length < 0){
+        length = 0;
+    } else if(length >= LOG_RECORD_SIZE){
+        length = LOG_RECORD_SIZE - 1;
+        record->text[length - 1] = '\n';
+    }
+    record->length = length;
+    record->sequence.store(pos + 1, std::memory_order_release);
+}
+
+// Stops the writer thread after it has written every pending record
+inline void LogShutdown(){
+    if(logger == nullptr){
+        return;
+    }
+    logger->running.store(false, std::memory_order_release);
+    if(logger->writer.joinable()){
+        logger->writer.join();
+    }
+    if(logger->fileFd != -1){
+        close(logger->fileFd);
+    }
+    delete logger;
+    logger = nullptr;
+}
+
+// Parses a comma-separated category list such as "launch,fault,table"; returns -1 on an unknown name
+inline int LogParseCategories(const char* list){
+    static const struct { const char* name; int category; } names[] = {
+        {"general", LOG_CAT_GENERAL}, {"launch", LOG_CAT_LAUNCH}, {"request", LOG_CAT_REQUEST},
+        {"fault", LOG_CAT_FAULT}, {"table", LOG_CAT_TABLE}, {"report", LOG_CAT_REPORT}, {"all", LOG_CAT_ALL}
+    };
+    int categories = 0;
+    const char* start = list;
+    while(*start != '\0'){
+        const char* end = strchr(start, ',');
+        size_t length = (end != nullptr) ? (size_t)(end - start) : strlen(start);
+        bool found = false;
+        for(const auto& entry : names){
+            if(strlen(entry.name) == length && strncmp(entry.name, start, length) == 0){
+                categories |= entry.category;
+                found = true;
+            }
+        }
+        if(!found){
+            return -1;
+        }
+        start += length;
+        if(*start == ','){
+            start++;
+        }
+    }
+    return categories;
+}
+
+#endif
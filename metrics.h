@@ -0,0 +1,93 @@
+// Latency histograms for oss's report: log-linear buckets in the style of HdrHistogram, so any value
+// from 1 ns to hours is recorded in constant time and space to within about 3% (each power of two is
+// split into 32 equal buckets). Buckets are atomic, so worker threads record without a lock
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <stdint.h>
+#include <atomic>
+
+#define HISTOGRAM_SUB_BITS 5 // log2 of the buckets each power of two is split into
+#define HISTOGRAM_SUB_BUCKETS (1 << HISTOGRAM_SUB_BITS)
+#define HISTOGRAM_BUCKETS (HISTOGRAM_SUB_BUCKETS * (64 - HISTOGRAM_SUB_BITS + 1))
+
+// Structures for one latency histogram, in ns
+struct LatencyHistogram {
+    std::atomic<uint64_t> buckets[HISTOGRAM_BUCKETS];
+    std::atomic<uint64_t> count;
+    std::atomic<uint64_t> total;
+    std::atomic<uint64_t> max;
+};
+
+// Returns the bucket a value falls in: values below HISTOGRAM_SUB_BUCKETS have one each, larger ones
+// share a bucket with the values agreeing in their top HISTOGRAM_SUB_BITS + 1 bits
+inline int HistogramBucket(uint64_t value){
+    if(value < HISTOGRAM_SUB_BUCKETS){
+        return (int)value;
+    }
+    int magnitude = 63 - __builtin_clzll(value) - HISTOGRAM_SUB_BITS;
+    int sub = (int)(value >> magnitude) - HISTOGRAM_SUB_BUCKETS;
+    return HISTOGRAM_SUB_BUCKETS * (magnitude + 1) + sub;
+}
+
+// Returns the largest value that falls in a bucket
+inline uint64_t HistogramBucketLimit(int bucket){
+    if(bucket < HISTOGRAM_SUB_BUCKETS){
+        return (uint64_t)bucket;
+    }
+    int magnitude = bucket / HISTOGRAM_SUB_BUCKETS - 1;
+    uint64_t sub = (uint64_t)(bucket % HISTOGRAM_SUB_BUCKETS + HISTOGRAM_SUB_BUCKETS);
+    return ((sub + 1) << magnitude) - 1;
+}
+
+inline void HistogramReset(LatencyHistogram* histogram){
+    for(int b = 0; b < HISTOGRAM_BUCKETS; b++){
+        histogram->buckets[b].store(0, std::memory_order_relaxed);
+    }
+    histogram->count = 0;
+    histogram->total = 0;
+    histogram->max = 0;
+}
+
+// Records one value; negative values (a clock that went backwards) count as 0
+inline void HistogramRecord(LatencyHistogram* histogram, long long value){
+    uint64_t v = (value > 0) ? (uint64_t)value : 0;
+    histogram->buckets[HistogramBucket(v)].fetch_add(1, std::memory_order_relaxed);
+    histogram->count.fetch_add(1, std::memory_order_relaxed);
+    histogram->total.fetch_add(v, std::memory_order_relaxed);
+    uint64_t seen = histogram->max.load(std::memory_order_relaxed);
+    while(v > seen && !histogram->max.compare_exchange_weak(seen, v, std::memory_order_relaxed)){
+    }
+}
+
+// Returns the value at or below which the given percentage of recorded values fall, as the limit of
+// the bucket it lands in (never more than the largest value recorded); 0 if nothing was recorded
+inline uint64_t HistogramPercentile(const LatencyHistogram* histogram, double percent){
+    uint64_t count = histogram->count.load(std::memory_order_relaxed);
+    if(count == 0){
+        return 0;
+    }
+    uint64_t rank = (uint64_t)(percent / 100.0 * count + 0.5);
+    if(rank < 1){
+        rank = 1;
+    } else if(rank > count){
+        rank = count;
+    }
+    uint64_t seen = 0;
+    uint64_t max = histogram->max.load(std::memory_order_relaxed);
+    for(int b = 0; b < HISTOGRAM_BUCKETS; b++){
+        seen += histogram->buckets[b].load(std::memory_order_relaxed);
+        if(seen >= rank){
+            uint64_t limit = HistogramBucketLimit(b);
+            return (limit < max) ? limit : max;
+        }
+    }
+    return max;
+}
+
+inline double HistogramMean(const LatencyHistogram* histogram){
+    uint64_t count = histogram->count.load(std::memory_order_relaxed);
+    return count ? (double)histogram->total.load(std::memory_order_relaxed) / count : 0.0;
+}
+
+#endif
@@ -16,375 +16,1730 @@
 #include <sys/wait.h>
 #include <sys/msg.h>
 #include <sys/mman.h>
+#include <sys/signalfd.h>
+#include <sys/eventfd.h>
+#include <sys/epoll.h>
 #include <fstream>
 #include <chrono>
 #include <queue>
+#include <algorithm>
 #include <random>
+#include <thread>
+#include <shared_mutex>
+#include <vector>
+#include <poll.h>
+#include "transport.h"
+#include "logger.h"
+#include "pager.h"
+#include "policy.h"
+#include "trace.h"
+#include "workload.h"
+#include "metrics.h"
+#include "control.h"
+#include "checkpoint.h"
 using namespace std;
 
 // Constants for system configuration
-#define MSG_WRITE 2
-#define MSG_READ 1
-#define TOTAL_RESOURCES 10
-#define TOTAL_INSTANCES 20
-#define DISPATCH_AMOUNT 1e7 // 10 ms
+#define USER_THINK_TIME 1000000LL // Simulated ns a user computes between a reply and its next request
+#define TABLE_DUMP_INTERVAL 500000000LL // Simulated ns between table dumps
+#define EVENT_LAUNCH 0
+#define EVENT_TABLE_DUMP 1
+#define EVENT_RECLAIM 2
+#define RECLAIM_INTERVAL 1000000LL // Simulated ns between reclaim passes while the pool is low
+#define RECLAIM_BATCH 32           // Frames a reclaim pass may examine
+#define DEFAULT_LOW_WATERMARK (frameTableSize / 32)
+#define DEFAULT_HIGH_WATERMARK (frameTableSize / 16)
+#define EVENT_DISK_DONE 3
+#define EVENT_ADMISSION 4
+#define EVENT_REQUEST 5 // A user's request arrives (an in-process user builds it then)
+#define EVENT_EXIT 6    // A forked user's exit takes effect
+#define EVENT_CHECKPOINT 7 // Not a simulation event: it neither counts as one nor is saved in a checkpoint
+#define DEFAULT_CHECKPOINT_INTERVAL 1000 // Simulated ms between checkpoints (-c)
+#define USER_EVENT_ORDER (1LL << 40) // Tie-break of user events, after every timer due at the same time
+#define ADMISSION_INTERVAL 20000000LL // Simulated ns between admission control checks
+#define DEFAULT_DISK_LATENCY 14000000LL // Simulated ns per paging I/O (rotation and transfer)
+#define DISK_SEEK_PER_BLOCK 2000LL      // Extra simulated ns per swap block the head travels
+#define DISK_TRANSFER_PER_PAGE 500000LL // Extra simulated ns per prepaged page a page-in also reads
+#define DISK_FIFO 0
+#define DISK_ELEVATOR 1
+#define MEMORY_ACCESS_TIME 100 // Simulated ns charged for a reference to a resident page
+#define WORKER_IDLE_TIMEOUT_MS 1 // Longest a worker or the worker-mode main loop sleeps between checks
 #define CHILD_LAUNCH_AMOUNT 1000
 #define UNBLOCK_AMOUNT 1000
 #define MSGQ_FILE_PATH "msgq.txt"
 #define MSGQ_PROJ_ID 65
 #define PERMS 0644
-#define MSG_GRANTED 4
-#define MSG_BLOCKED 3
-
-// Structures for system operation
-typedef struct SystemClock {
-    int seconds;
-    int nanoseconds;
-} SystemClock;
-
-// Structures for PCB
-struct ProcessControlBlock {
-    int isOccupied;
-    pid_t pid;
-    int startSecs;
-    int startNanos;
-    int blocked;
-    int resourcesHeld[TOTAL_RESOURCES];
-};
-
-// Structures for Page Table Entry
-struct PageTableEntry{
-    pid_t pid;
-    int pageNumber;
-    bool secondChanceBit;
-    bool dirtyBit;
-};
 
-// Structures for Message Buffer
-typedef struct MessageBuffer {
-        long mtype;
-        int msgCode;
-        int memoryAddress;
-        pid_t sender;
-} MessageBuffer;
+// Index over the process table: occupied and free slot lists threaded through the PCBs, a pid hash
+// index and live counters, so slot allocation, pid lookups and the event loop's checks are O(1)
+int freeSlotHead = -1;
+int occupiedSlotHead = -1;   // In launch order, so the table dump lists processes as they started
+int occupiedSlotTail = -1;
+std::vector<int> pidBuckets; // First slot in each bucket, -1 when empty
+int pidBucketMask = 0;
+std::atomic<int> activeProcessCount{0};
+std::atomic<int> blockedProcessCount{0};
+
+// Returns the pid index bucket a pid hashes to
+int PidBucket(pid_t pid){
+    return (int)(((uint64_t)(uint32_t)pid * 0x9E3779B97F4A7C15ull) >> 32) & pidBucketMask;
+}
 
 // Function Prototypes
-// Initializes the process table to default values
+// Initializes the process table to default values and links every slot into the free list
 void InitializeProcessTable(ProcessControlBlock processTable[]){
-    for(int i = 0; i < 20; i++){
+    for(int i = 0; i < processTableSize; i++){
         processTable[i].isOccupied = 0;
         processTable[i].pid = 0;
-        processTable[i].startSecs = 0;
-        processTable[i].startNanos = 0;
+        processTable[i].startTime = 0;
         processTable[i].blocked = 0;
+        processTable[i].blockedUntil = 0;
         for(int j = 0; j < TOTAL_RESOURCES; j++){
             processTable[i].resourcesHeld[j] = 0;
         }
+        // Linked in ascending order so the lowest slots are handed out first
+        processTable[i].nextSlot = (i + 1 < processTableSize) ? i + 1 : -1;
+        processTable[i].prevSlot = -1;
+        processTable[i].nextInBucket = -1;
     }
+    freeSlotHead = (processTableSize > 0) ? 0 : -1;
+    occupiedSlotHead = occupiedSlotTail = -1;
+    int buckets = 1;
+    while(buckets < processTableSize * 2){
+        buckets <<= 1;
+    }
+    pidBuckets.assign(buckets, -1);
+    pidBucketMask = buckets - 1;
+    activeProcessCount = 0;
+    blockedProcessCount = 0;
 }
 
 // Finds an empty slot in the process table
-int FindEmptyProcessSlot(ProcessControlBlock processTable[], int maxSimultaneousProcesses){
-    for(int i = 0; i < maxSimultaneousProcesses; i++){
-        if (!processTable[i].isOccupied){
-            return (i + 1);
-        }
+int FindEmptyProcessSlot(){
+    return freeSlotHead + 1;
+}
+
+// Moves the slot FindEmptyProcessSlot returned onto the occupied list and indexes it under pid
+void InsertProcessIntoTable(ProcessControlBlock processTable[], int i, pid_t pid){
+    freeSlotHead = processTable[i].nextSlot;
+    processTable[i].isOccupied = 1;
+    processTable[i].pid = pid;
+    processTable[i].prevSlot = occupiedSlotTail;
+    processTable[i].nextSlot = -1;
+    if(occupiedSlotTail != -1){
+        processTable[occupiedSlotTail].nextSlot = i;
+    } else {
+        occupiedSlotHead = i;
     }
-    return 0;
+    occupiedSlotTail = i;
+    int bucket = PidBucket(pid);
+    processTable[i].nextInBucket = pidBuckets[bucket];
+    pidBuckets[bucket] = i;
+    activeProcessCount++;
 }
 
 // Counts the number of active processes in the table
-int CountActiveProcesses(ProcessControlBlock processTable[], int maxSimultaneousProcesses){
-    int numProcesses = 0;
-    for(int i = 0; i < maxSimultaneousProcesses; i++){
-        if (processTable[i].isOccupied){
-            numProcesses++;
-        }
-    }
+int CountActiveProcesses(){
+    int numProcesses = activeProcessCount;
     return (numProcesses == 0) ? 1 : numProcesses; // Ensures never zero to prevent divide by zero error
 }
 
 // Checks if the process table is empty
-bool IsProcessTableEmpty(ProcessControlBlock processTable[], int maxSimultaneousProcesses){
-    for(int i = 0; i < maxSimultaneousProcesses; i++){
-        if (processTable[i].isOccupied){
-            return 0;
+bool IsProcessTableEmpty(){
+    return activeProcessCount == 0;
+}
+
+// Checks if all processes are blocked
+bool AreAllProcessesBlocked(){
+    return blockedProcessCount == activeProcessCount;
+}
+
+// Displays the occupied slots of the process table in the log (driven by the table dump timer)
+void DisplayProcessTable(ProcessControlBlock processTable[], long long now){
+    if(!LogEnabled(LOG_INFO, LOG_CAT_TABLE)){
+        return;
+    }
+    LogPrintf(LOG_INFO, LOG_CAT_TABLE, "OSS PID: %d  SysClockS: %d  SysClockNano: %d  \nProcess Table:\nEntry\tOccupied  PID\tStartS\tStartN\t\tBlocked\tUnblockedS  UnblockedN\n", getpid(), TimeSeconds(now), TimeNanoseconds(now));
+    for(int i = occupiedSlotHead; i != -1; i = processTable[i].nextSlot){
+        const char* tab = (TimeNanoseconds(processTable[i].startTime) == 0) ? "\t\t" : "\t";
+        char r_list[TOTAL_RESOURCES * 8];
+        int used = 0;
+        for(int j = 0; j < TOTAL_RESOURCES; j++){
+            used += snprintf(r_list + used, sizeof(r_list) - used, "%c:%d ", 'A' + j, processTable[i].resourcesHeld[j]);
         }
+        LogPrintf(LOG_INFO, LOG_CAT_TABLE, "%d\t%d\t%d\t%d\t%d%s%d\t%d\t    %d\t%s\n", i + 1, processTable[i].isOccupied, processTable[i].pid, TimeSeconds(processTable[i].startTime), TimeNanoseconds(processTable[i].startTime), tab, processTable[i].blocked,
+                  TimeSeconds(processTable[i].blockedUntil), TimeNanoseconds(processTable[i].blockedUntil), r_list);
     }
-    return 1;
 }
 
-// Checks if all processes are blocked
-bool AreAllProcessesBlocked(ProcessControlBlock processTable[], int maxSimultaneousProcesses){
-    for(int i = 0; i < maxSimultaneousProcesses; i++){
-        if (processTable[i].isOccupied && !processTable[i].blocked){
-            return 0;
+// Returns the index of a process in the table based on its PID
+int GetProcessIndex(ProcessControlBlock processTable[], pid_t pid){
+    for(int i = pidBuckets[PidBucket(pid)]; i != -1; i = processTable[i].nextInBucket){
+        if(processTable[i].pid == pid){
+            return i;
         }
     }
-    return 1;
+    return -1;
+}
+
+// Removes a process from the table upon termination
+void RemoveProcessFromTable(ProcessControlBlock processTable[], pid_t pid){
+    int i = GetProcessIndex(processTable, pid);
+    if(i == -1){
+        return;
+    }
+    ReleaseProcessFrames(&processTable[i]);
+    ResetSharedMappings(i);
+    int* link = &pidBuckets[PidBucket(pid)];
+    while(*link != i){
+        link = &processTable[*link].nextInBucket;
+    }
+    *link = processTable[i].nextInBucket;
+    if(processTable[i].prevSlot != -1){
+        processTable[processTable[i].prevSlot].nextSlot = processTable[i].nextSlot;
+    } else {
+        occupiedSlotHead = processTable[i].nextSlot;
+    }
+    if(processTable[i].nextSlot != -1){
+        processTable[processTable[i].nextSlot].prevSlot = processTable[i].prevSlot;
+    } else {
+        occupiedSlotTail = processTable[i].prevSlot;
+    }
+    processTable[i].nextSlot = freeSlotHead;
+    processTable[i].prevSlot = -1;
+    processTable[i].nextInBucket = -1;
+    freeSlotHead = i;
+    activeProcessCount--;
+    if(processTable[i].blocked){
+        blockedProcessCount--;
+    }
+
+    processTable[i].isOccupied = 0;
+    processTable[i].pid = 0;
+    processTable[i].startTime = 0;
+    processTable[i].blocked = 0;
+    processTable[i].blockedUntil = 0;
+    for(int j = 0; j < TOTAL_RESOURCES; j++){
+        processTable[i].resourcesHeld[j] = 0;
+    }
 }
 
-// Displays the process table in the output file
-void DisplayProcessTable(ProcessControlBlock processTable[], int maxSimultaneousProcesses, int seconds, int nanoseconds, std::ostream& outputFile){
-    static int next_print_secs = 0;
-    static int next_print_nanos = 0;
+// Updates a process as blocked in the table; the unblock time is 0 until its page-in is in service
+void UpdateBlockedProcess(ProcessControlBlock processTable[], pid_t pid, long long blockedUntil){
+    int i = GetProcessIndex(processTable, pid);
+    if(i == -1){
+        return;
+    }
+    if(!processTable[i].blocked){
+        processTable[i].blocked = 1;
+        blockedProcessCount++;
+    }
+    processTable[i].blockedUntil = blockedUntil;
+}
 
-    if(seconds > next_print_secs || (seconds == next_print_secs && nanoseconds > next_print_nanos)){
-        printf("OSS PID: %d  SysClockS: %d  SysClockNano: %d  \nProcess Table:\nEntry\tOccupied  PID\tStartS\tStartN\t\tBlocked\tUnblockedS  UnblockedN\n", getpid(), seconds, nanoseconds);
-        outputFile << "OSS PID: " << getpid() << "  SysClockS: " << seconds << "  SysClockNano " << nanoseconds << "  \nProcess Table:\nEntry\tOccupied  PID\tStartS\tStartN\t\tBlocked\tUnblockedS  UnblockedN\n";
-        for(int i = 0; i < maxSimultaneousProcesses; i++){
-            std::string tab = (processTable[i].startNanos == 0) ? "\t\t" : "\t";
-            std::string r_list = "";
-
-            for(int j = 0; j < TOTAL_RESOURCES; j++){
-                r_list += static_cast<char>(65 + j);
-                r_list += ":";
-                r_list += std::to_string(processTable[i].resourcesHeld[j]);
-                r_list += " ";
-            }
+// Marks a blocked process as runnable again
+void UnblockProcess(ProcessControlBlock* pcb){
+    if(pcb->blocked){
+        pcb->blocked = 0;
+        blockedProcessCount--;
+    }
+    pcb->blockedUntil = 0;
+}
 
-            std::cout << std::to_string(i + 1) << "\t" << std::to_string(processTable[i].isOccupied) << "\t" << std::to_string(processTable[i].pid) << "\t" << std::to_string(processTable[i].startSecs) << "\t" << std::to_string(processTable[i].startNanos) << tab << std::to_string(processTable[i].blocked) << "\t" << r_list << std::endl;
-            outputFile << std::to_string(i + 1) << "\t" << std::to_string(processTable[i].isOccupied) << "\t" << std::to_string(processTable[i].pid) << "\t" << std::to_string(processTable[i].startSecs) << "\t" << std::to_string(processTable[i].startNanos) << tab << std::to_string(processTable[i].blocked) << "\t" << r_list << std::endl;
-        }
-        next_print_nanos = next_print_nanos + 500000000;
-        if (next_print_nanos >= 1000000000){
-            next_print_nanos = next_print_nanos - 1000000000;
-            next_print_secs++;
+// Terminates all processes when the system is cleaning up
+void TerminateAllProcesses(ProcessControlBlock processTable[]){
+    for(int i = occupiedSlotHead; i != -1; i = processTable[i].nextSlot){
+        kill(processTable[i].pid, SIGKILL);
+    }
+}
+
+// Checks if a specific process ID is present in the process table
+bool IsProcessPresent(ProcessControlBlock processTable[], pid_t pid){
+    return GetProcessIndex(processTable, pid) != -1;
+}
+
+int maxSimultaneousProcesses = 1;
+
+// Send a message to the child in a process table slot over the selected transport
+void SendMessageToProcess(int, MessageBuffer);
+
+int batchSize = 1;
+std::atomic<long long> ipcSyscalls{0};      // msgsnd/msgrcv calls made by oss, including empty polls
+std::atomic<long long> childIpcSyscalls{0}; // msgsnd/msgrcv or futex calls made by children
+int transport = TRANSPORT_MSGQ;
+ChannelPair* channels = nullptr; // One ring pair per process table slot when transport is TRANSPORT_RING
+int shmrid = -1;
+int nextRingToPoll[TOTAL_INSTANCES]; // Per worker, where its round-robin scan of the rings resumes
+std::atomic<bool>* ringClaimed = nullptr; // Per slot, set while a worker is popping its request ring
+Trace referenceTrace;          // Binary reference trace written with -r
+std::atomic<bool> recordingTrace{false}; // Cleared under traceLock if the file cannot grow, read unlocked to skip the lock
+std::mutex traceLock;
+
+// Worker threads (-j); with one, requests are handled on the main thread exactly as before
+int workerCount = 1;
+std::vector<std::thread> workers;
+std::atomic<bool> workersRunning{false};
+// Held shared while a request is handled and exclusively while a slot is filled or emptied
+std::shared_mutex processTableLock;
+std::mutex diskLock;
+int mainWakeFd = -1;                       // eventfd workers write to when the main loop has work to run
+std::atomic<bool> mainWakePending{false};  // A wake-up has been written and not yet read
+std::atomic<long long> mainNextEventDue{-1}; // Earliest pending event as of the main loop's last pass
+
+// Wakes the worker-mode main loop so it runs due timers and starts queued page-ins
+void WakeMainLoop(){
+    if(mainWakeFd != -1 && !mainWakePending.exchange(true)){
+        uint64_t one = 1;
+        write(mainWakeFd, &one, sizeof(one));
+    }
+}
+long long diskLatency = DEFAULT_DISK_LATENCY; // 0 makes page faults complete instantly
+int diskScheduler = DISK_FIFO;
+long long faultServiceTime = 0; // Simulated ns from fault to page-in, summed over every fault
+long long blockedTime = 0;      // Simulated ns processes spent blocked, summed
+
+// In-process users (-E inproc): each slot's user is stepped on the main thread and talks to the
+// memory manager through direct calls instead of being forked and exec'd as ./user
+struct InProcessUser {
+    UserState state;
+    MessageBuffer request;
+    MessageBuffer reply;
+    std::chrono::steady_clock::time_point sentAt; // When its outstanding request was dispatched
+};
+bool inProcessMode = false;
+std::vector<InProcessUser> inProcessUsers; // Indexed by slot
+pid_t nextInProcessPid = 1; // Simulated pids; they are never passed to kill or waitpid
+
+// Workload every user generates (-W, -R), with each user's generator seeded from the run seed (-S)
+std::string workloadName = DEFAULT_WORKLOAD;
+WorkloadSpec workload;
+int readPercent = READ_CHANCE;
+uint64_t runSeed = 0;
+int launchCount = 0; // Users launched so far; with the slot it picks each user's seed
+
+// Checkpoints (-c, -k): how far each slot's user has got, which with its seed is all it takes to put the
+// user back where it was. While checkpoints are being written oss follows every user's batch: the
+// references it has generated and, as replies grant them, those it is still to have granted
+struct UserProgress {
+    uint64_t generated;    // References generated so far
+    int outstanding;       // Its batch has been dispatched and the reply is not sent yet
+    MessageBuffer request; // Its references generated but not granted yet
+};
+std::vector<UserProgress> userProgress; // Indexed by slot
+string checkpointPath = "";
+long long checkpointInterval = DEFAULT_CHECKPOINT_INTERVAL * 1000000LL; // Simulated ns, 0 for only on a signal
+int checkpointsWritten = 0;
+
+// Starts following a user newly placed in a slot
+void ResetUserProgress(int slot){
+    if(!checkpointPath.empty()){
+        userProgress[slot].generated = 0;
+        userProgress[slot].outstanding = 0;
+        userProgress[slot].request.count = 0;
+    }
+}
+
+// Notes a slot's batch as it is handled; a parked one being handled again adds nothing
+void NoteUserRequest(int slot, const MessageBuffer* request){
+    if(checkpointPath.empty()){
+        return;
+    }
+    UserProgress* progress = &userProgress[slot];
+    progress->generated += request->count - progress->request.count;
+    progress->request.count = request->count;
+    memcpy(progress->request.references, request->references, request->count * sizeof(MemoryReference));
+    progress->outstanding = 1;
+}
+
+// Notes the reply to a slot's batch
+void NoteUserReply(int slot, const MessageBuffer* reply){
+    if(checkpointPath.empty()){
+        return;
+    }
+    ApplyReply(&userProgress[slot].request, reply);
+    userProgress[slot].outstanding = 0;
+}
+
+// Queue a page-in on the paging device and block the faulting process until it completes
+void QueuePageIn(int, int, int, MessageBuffer*);
+
+// Appends a record to the trace being recorded; if the file cannot grow, the records so far are kept and
+// recording stops for the rest of the run
+void AppendTraceRecord(pid_t pid, int memoryAddress, int type, uint64_t time){
+    std::lock_guard<std::mutex> lock(traceLock);
+    if(recordingTrace && !TraceAppend(&referenceTrace, pid, memoryAddress, type, time)){
+        LogPrintf(LOG_ERROR, LOG_CAT_GENERAL, "OSS: Unable to grow the trace file, recording stopped after %llu records\n",
+                  (unsigned long long)referenceTrace.capacity);
+        TraceCloseWriter(&referenceTrace);
+        recordingTrace = false;
+    }
+}
+
+// Appends a resolved reference to the trace being recorded
+void RecordReference(pid_t pid, int memoryAddress, int msgCode, uint64_t time){
+    if(recordingTrace){
+        AppendTraceRecord(pid, memoryAddress, (msgCode == MSG_WRITE) ? TRACE_WRITE : TRACE_READ, time);
+    }
+}
+
+// Shared memory holding the inverted frame table followed by every slot's page table
+key_t memory_key = ftok("/tmp", 36);
+int shmmid = -1; // Created once -s and -g have sized the tables
+void* memorySegment = nullptr;
+
+// Creates a shared memory segment, replacing a smaller one a previous run left under the same key
+int CreateSharedSegment(key_t key, size_t size){
+    int id = shmget(key, size, IPC_CREAT | 0666);
+    if(id == -1 && errno == EINVAL){
+        int stale = shmget(key, 0, 0666);
+        if(stale != -1){
+            shmctl(stale, IPC_RMID, NULL);
         }
+        id = shmget(key, size, IPC_CREAT | 0666);
     }
+    return id;
 }
 
-// Removes a process from the table upon termination
-void RemoveProcessFromTable(ProcessControlBlock processTable[], pid_t pid, int maxSimultaneousProcesses){
-    for(int i = 0; i < maxSimultaneousProcesses; i++){
-        if(processTable[i].pid == pid){
-            processTable[i].isOccupied = 0;
-            processTable[i].pid = 0;
-            processTable[i].startSecs = 0;
-            processTable[i].startNanos = 0;
-            processTable[i].blocked = 0;
-            for(int j = 0; j < TOTAL_RESOURCES; j++){
-                processTable[i].resourcesHeld[j] = 0;
-            }
+// Displays the page table in the log (driven by the table dump timer)
+void DisplayPageTable(long long now){
+    if(!LogEnabled(LOG_INFO, LOG_CAT_TABLE)){
+        return;
+    }
+    LogPrintf(LOG_INFO, LOG_CAT_TABLE, "OSS PID: %d  SysClockS: %d  SysClockNano %d  \nPage Table:\n\tOwner PID\tPage Number\t2nd Chance Bit\tDirty Bit\tMappings\n", getpid(), TimeSeconds(now), TimeNanoseconds(now));
+    for(int i = 0; i < frameTableSize; i++){
+        LogPrintf(LOG_INFO, LOG_CAT_TABLE, "Frame %d:\t%d\t%d\t%d\t%d\t%d\n", i + 1, FramePid(i), frameTable.pageNumber[i],
+                  TestFrameBit(frameTable.referenceBits, i), TestFrameBit(frameTable.dirtyBits, i), frameTable.mapCount[i]);
+    }
+}
+
+// The simulated clock: oss keeps it as atomic nanoseconds so worker threads can advance it together,
+// and publishes every new value to the control segment children read
+ControlSegment* control = nullptr;
+std::atomic<long long> clockTime{0};
+
+// Copies a clock value into the control segment
+void PublishClock(long long time){
+    ClockPublish(&control->clock, time);
+}
+
+// Returns the simulated clock as nanoseconds
+long long SimulatedTime(){
+    return clockTime.load();
+}
+
+// Moves the simulated clock forward to the given time
+void AdvanceClockTo(long long time){
+    long long now = clockTime.load();
+    while(time > now){
+        if(clockTime.compare_exchange_weak(now, time)){
+            PublishClock(time);
             return;
         }
     }
 }
 
-// Updates a process as blocked in the table
-void UpdateBlockedProcess(ProcessControlBlock processTable[], pid_t pid, int maxSimultaneousProcesses, int blockedUntilSec, int blockedUntilNano){
-    for(int i = 0; i < maxSimultaneousProcesses; i++){
-        if(processTable[i].pid == pid){
+// Increment the system clock
+void IncrementClock(long long increment_amount){
+    PublishClock(clockTime.fetch_add(increment_amount) + increment_amount);
+}
+
+// Returns the simulated ns a reference to a resident page costs: with a TLB, the lookup plus, when it
+// misses, a page table walk of one more memory access
+long long ResidentAccessTime(bool tlbHit){
+    if(tlbEntries == 0){
+        return MEMORY_ACCESS_TIME;
+    }
+    return TLB_LOOKUP_TIME + (tlbHit ? MEMORY_ACCESS_TIME : 2 * MEMORY_ACCESS_TIME);
+}
+
+// Metrics for the report: each process's counters, kept in its slot while it runs and moved to the
+// finished list when it exits, and the service latency of every request, from when it is first handled
+// to when its reply is sent, in simulated and in wall-clock time
+struct ProcessMetrics {
+    pid_t pid;
+    int slot;
+    int launch;            // Which launch it was; with the slot and the run seed it names its reference stream
+    long long startedAt;   // Simulated ns
+    long long endedAt;     // Simulated ns, -1 while it is running
+    long long requests;
+    long long hits;
+    long long faults;
+    long long writeBacks;  // Its dirty pages written back, whether evicted, reclaimed or swapped out
+    long long blockedTime; // Simulated ns spent waiting on page-ins or suspended
+    long long parkedAt;    // Simulated ns its request was parked, -1 when none is
+    long long referencesGenerated; // The rest are counted by the user itself in its slot's SlotStats
+    long long writesGenerated;
+    long long blockedReplies;
+    long long replyWaitTime;       // Wall-clock ns
+};
+std::vector<ProcessMetrics> slotMetrics;     // Indexed by slot
+std::vector<ProcessMetrics> finishedMetrics; // In exit order
+std::vector<long long> requestStartedAt;     // Per slot, -1 when no request is outstanding
+std::vector<std::chrono::steady_clock::time_point> requestStartedWall;
+LatencyHistogram simulatedLatency;
+LatencyHistogram wallLatency;
+string reportPrefix = ""; // -o: the report is also written to prefix.json and prefix.csv
+
+// Allocates the counters of every slot
+void InitializeMetrics(int slots){
+    slotMetrics.assign(slots, ProcessMetrics());
+    requestStartedAt.assign(slots, -1);
+    requestStartedWall.resize(slots);
+    HistogramReset(&simulatedLatency);
+    HistogramReset(&wallLatency);
+}
+
+// Starts the counters of a process newly placed in a slot
+void ResetProcessMetrics(int slot, pid_t pid, int launch){
+    ProcessMetrics* metrics = &slotMetrics[slot];
+    *metrics = ProcessMetrics();
+    metrics->pid = pid;
+    metrics->slot = slot;
+    metrics->launch = launch;
+    metrics->startedAt = SimulatedTime();
+    metrics->endedAt = -1;
+    metrics->parkedAt = -1;
+    processWriteBacks[slot] = 0;
+    requestStartedAt[slot] = -1;
+}
+
+// Notes that a slot's request is being handled; a parked request keeps the time it first arrived
+void StartRequestTimer(int slot){
+    if(requestStartedAt[slot] != -1){
+        return;
+    }
+    requestStartedAt[slot] = SimulatedTime();
+    requestStartedWall[slot] = std::chrono::steady_clock::now();
+    slotMetrics[slot].requests++;
+}
+
+// Records the service latency of a slot's request as its reply is sent
+void StopRequestTimer(int slot){
+    if(requestStartedAt[slot] == -1){
+        return;
+    }
+    HistogramRecord(&simulatedLatency, SimulatedTime() - requestStartedAt[slot]);
+    std::chrono::nanoseconds wall = std::chrono::steady_clock::now() - requestStartedWall[slot];
+    HistogramRecord(&wallLatency, wall.count());
+    requestStartedAt[slot] = -1;
+}
+
+// Returns a slot's counters with its write-backs and the counters its user keeps filled in
+ProcessMetrics SnapshotProcessMetrics(int slot){
+    ProcessMetrics metrics = slotMetrics[slot];
+    metrics.writeBacks = processWriteBacks[slot];
+    SlotStats* stats = ControlSlotStats(control, slot);
+    metrics.referencesGenerated = stats->references.load(std::memory_order_relaxed);
+    metrics.writesGenerated = stats->writes.load(std::memory_order_relaxed);
+    metrics.blockedReplies = stats->blockedReplies.load(std::memory_order_relaxed);
+    metrics.replyWaitTime = stats->waitTime.load(std::memory_order_relaxed);
+    return metrics;
+}
+
+// Admission control (-A): each process's working set is sampled as the distinct pages it referenced in
+// its last window of references. A launch waits while the working sets of the running processes plus
+// an estimate for the newcomer would not fit in the frame table, and with suspension enabled the newest
+// process is swapped out while they already do not fit; its next request is parked until it is resumed
+int workingSetWindow = 0; // References per working-set sample, 0 disables admission control
+bool admissionSuspends = false;
+int workingSetWords = 0;  // Bitset words covering one process's pages
+std::vector<uint64_t> workingSetBits;     // Pages referenced in the current window, workingSetWords per slot
+std::vector<int> workingSetReferences;    // References so far in the current window, per slot
+std::atomic<int>* workingSetSize;         // Last sample per slot, -1 before the first
+std::atomic<long long> workingSetSampleTotal{0};
+std::atomic<long long> workingSetSamples{0};
+std::vector<MessageBuffer> parkedRequests; // Indexed by slot
+std::vector<char> requestParked;
+int suspendedCount = 0;
+bool launchWaitingForMemory = false; // A launch came due while the working sets filled memory
+int launchesDelayed = 0;
+int suspensions = 0;
+int swappedOutPages = 0;
+int peakMemoryDemand = 0;
+
+// Allocates the working-set samples and parked requests of every slot
+void InitializeAdmissionControl(int slots){
+    workingSetWords = (pagesPerProcess + 63) / 64;
+    workingSetBits.assign((size_t)slots * workingSetWords, 0);
+    workingSetReferences.assign(slots, 0);
+    workingSetSize = new std::atomic<int>[slots];
+    for(int i = 0; i < slots; i++){
+        workingSetSize[i].store(-1);
+    }
+    parkedRequests.resize(slots);
+    requestParked.assign(slots, 0);
+}
+
+// Forgets a slot's working set, for a process newly placed in it
+void ResetWorkingSet(int slot){
+    if(workingSetWindow == 0){
+        return;
+    }
+    memset(&workingSetBits[(size_t)slot * workingSetWords], 0, workingSetWords * sizeof(uint64_t));
+    workingSetReferences[slot] = 0;
+    workingSetSize[slot].store(-1);
+}
+
+// Adds a reference to the working-set sample of the process in a slot, closing the window when it is full
+void NoteWorkingSetReference(int slot, int memoryAddress){
+    if(workingSetWindow == 0){
+        return;
+    }
+    uint64_t* bits = &workingSetBits[(size_t)slot * workingSetWords];
+    int pageNumber = PageNumber(memoryAddress);
+    bits[pageNumber / 64] |= 1ull << (pageNumber % 64);
+    if(++workingSetReferences[slot] < workingSetWindow){
+        return;
+    }
+    int pages = 0;
+    for(int w = 0; w < workingSetWords; w++){
+        pages += __builtin_popcountll(bits[w]);
+        bits[w] = 0;
+    }
+    workingSetReferences[slot] = 0;
+    workingSetSize[slot].store(pages);
+    workingSetSampleTotal += pages;
+    workingSetSamples++;
+}
+
+// Returns the working set expected of a process that has not completed a window yet: the average sample
+// so far, or a whole window of distinct pages before there is any
+int NewcomerWorkingSet(){
+    long long samples = workingSetSamples;
+    if(samples > 0){
+        return (int)(workingSetSampleTotal / samples);
+    }
+    return (workingSetWindow < pagesPerProcess) ? workingSetWindow : pagesPerProcess;
+}
+
+// Returns the frames the running (not suspended) processes' working sets need
+int MemoryDemand(){
+    int demand = 0;
+    for(int i = occupiedSlotHead; i != -1; i = processTable[i].nextSlot){
+        if(!processTable[i].suspended){
+            int size = workingSetSize[i];
+            demand += (size >= 0) ? size : NewcomerWorkingSet();
+        }
+    }
+    return demand;
+}
+
+// Returns true if another process may be launched without overcommitting memory; suspended processes
+// are resumed before anything new is admitted
+bool AdmitLaunch(){
+    if(workingSetWindow == 0 || activeProcessCount == 0){
+        return true;
+    }
+    return suspendedCount == 0 && MemoryDemand() + NewcomerWorkingSet() <= frameTableSize;
+}
+
+// Holds the request of a suspended process until it is resumed; it counts as blocked meanwhile
+void ParkRequest(int slot, MessageBuffer* request){
+    parkedRequests[slot] = *request;
+    requestParked[slot] = 1;
+    slotMetrics[slot].parkedAt = SimulatedTime();
+    if(!processTable[slot].blocked){
+        processTable[slot].blocked = 1;
+        blockedProcessCount++;
+    }
+    LogPrintf(LOG_INFO, LOG_CAT_LAUNCH, "OSS: Parking the request of suspended process %d\n", request->sender);
+}
+
+// Resolves a batch of references in order, stopping at the first fault, and sends a single reply
+void HandleBatchRequest(MessageBuffer* request){
+    MessageBuffer buf;
+    buf.mtype = request->sender;
+    buf.sender = getpid();
+    buf.memoryAddress = 0;
+    buf.count = 0;
+    buf.blockedIndex = -1;
 
-            processTable[i].blocked = 1;
+    int slot = GetProcessIndex(processTable, request->sender);
+    if(slot == -1){
+        return; // Sender has already been reaped
+    }
+    NoteUserRequest(slot, request);
+    StartRequestTimer(slot);
+    if(processTable[slot].suspended){
+        ParkRequest(slot, request);
+        return;
+    }
+
+    for(int i = 0; i < request->count; i++){
+        buf.count++;
+        int memoryAddress = request->references[i].memoryAddress;
+        int msgCode = request->references[i].msgCode;
+        uint64_t now = SimulatedTime();
+        NoteWorkingSetReference(slot, memoryAddress);
+        bool tlbHit;
+        if(ReferenceResidentPage(slot, memoryAddress, msgCode, &tlbHit)){
+            RecordReference(request->sender, memoryAddress, msgCode, now);
+            IncrementClock(ResidentAccessTime(tlbHit));
+            slotMetrics[slot].hits++;
+            continue;
+        }
+        slotMetrics[slot].faults++;
+
+        // The faulting reference is granted along with the hits before it once its page is in
+        buf.blockedIndex = i;
+        buf.msgCode = MSG_BLOCKED;
+        if(diskLatency > 0){
+            QueuePageIn(slot, memoryAddress, msgCode, &buf);
             return;
         }
+        RecordReference(request->sender, memoryAddress, msgCode, now);
+        CompletePageFault(slot, memoryAddress, msgCode);
+        break;
+    }
+    if(buf.blockedIndex == -1){
+        buf.msgCode = MSG_GRANTED;
     }
+    SendMessageToProcess(slot, buf);
 }
 
-// Terminates all processes when the system is cleaning up
-void TerminateAllProcesses(ProcessControlBlock processTable[], int maxSimultaneousProcesses){
-    for(int i = 0; i < maxSimultaneousProcesses; i++){
-        if(processTable[i].isOccupied){
-            kill(processTable[i].pid, SIGKILL);
+
+void LaunchProcess();
+bool ReceiveRequest(MessageBuffer*, int);
+void HandleTimeout(int);
+void HandleInterrupt(int);
+void CleanupSystem(std::string);
+void RemoveSharedResources();
+void OutputStats(double, long long);
+
+// Signal handling global
+volatile sig_atomic_t term = 0;
+
+// Global variables for system management
+key_t control_key = ftok("/tmp", CONTROL_PROJ_ID);
+int shmtid = -1; // Created once -s has sized the slot counters
+int msgqid;
+int successfulTerminations = 0;
+int numberOfChildren = 1;
+int launchInterval = 100;
+bool launchWaitingForSlot = false; // A launch came due while every slot was occupied
+bool reclaimActive = false;        // The pool went below the low watermark and has not yet reached the high one
+bool reclaimScheduled = false;     // A EVENT_RECLAIM is pending
+int sigchldFd = -1;                 // signalfd delivering SIGCHLD
+int wakeFd = -1;                    // eventfd children write to when oss is asleep
+int epollFd = -1;
+Doorbell* doorbell;
+int shmdid = -1;
+
+// Event queue at the core of the simulation: a binary min-heap of pending events keyed on simulated ns.
+// The clock jumps straight from one event to the next, so idle stretches cost nothing. Events due at
+// the same time run timers first, in the order they were scheduled, then users' requests and exits by
+// slot, so a run does not depend on the order the host happened to deliver messages in
+struct Event {
+    long long due;
+    long long order; // Breaks ties between events due at the same time
+    int type;
+    int slot;        // EVENT_REQUEST and EVENT_EXIT: the user's slot and pid
+    pid_t pid;
+};
+std::vector<Event> eventQueue;
+long long eventsScheduled = 0;
+long long eventsFired = 0;
+
+// Per slot: when its user will send its next request or exit, and, for forked users while the single
+// threaded loop runs, whether that has not arrived yet and the request once it has
+std::vector<long long> userReadyAt;
+std::vector<char> awaitingRequest;
+std::vector<MessageBuffer> arrivedRequests;
+
+// Orders the heap: true if a fires after b
+bool EventAfter(const Event& a, const Event& b){
+    return (a.due != b.due) ? a.due > b.due : a.order > b.order;
+}
+
+// Returns the tie-break of a user's request or exit; its exit comes after a request it sent
+long long UserEventOrder(int slot, int type){
+    return USER_EVENT_ORDER + 2LL * slot + (type == EVENT_EXIT);
+}
+
+// Schedules an event of the given type for the simulated clock reaching due
+void ScheduleEvent(int type, long long due, int slot = -1, pid_t pid = 0){
+    long long order = (type == EVENT_REQUEST || type == EVENT_EXIT) ? UserEventOrder(slot, type) : eventsScheduled;
+    eventsScheduled++;
+    eventQueue.push_back({due, order, type, slot, pid});
+    std::push_heap(eventQueue.begin(), eventQueue.end(), EventAfter);
+}
+
+// Returns the due time of the earliest pending event, or -1 if none are pending
+long long NextEventDue(){
+    return eventQueue.empty() ? -1 : eventQueue.front().due;
+}
+
+void FireEvent(const Event&);
+
+// Takes the earliest event off the queue, moves the clock to it and fires it
+void RunEvent(){
+    std::pop_heap(eventQueue.begin(), eventQueue.end(), EventAfter);
+    Event event = eventQueue.back();
+    eventQueue.pop_back();
+    AdvanceClockTo(event.due);
+    if(event.type != EVENT_CHECKPOINT){
+        eventsFired++;
+    }
+    FireEvent(event);
+}
+
+// Runs the earliest event if it comes before horizon (nullptr for no limit); returns false if it does not
+bool RunNextEvent(const Event* horizon){
+    if(eventQueue.empty() || (horizon != nullptr && !EventAfter(*horizon, eventQueue.front()))){
+        return false;
+    }
+    RunEvent();
+    return true;
+}
+
+// Fires every event the clock has already reached; with worker threads, served requests move the clock
+void RunDueEvents(){
+    while(!eventQueue.empty() && eventQueue.front().due <= SimulatedTime()){
+        RunEvent();
+    }
+}
+
+// Sets horizon to the earliest request or exit a forked user may still send; returns false if none may
+bool ArrivalHorizon(Event* horizon){
+    bool limited = false;
+    for(int i = occupiedSlotHead; i != -1; i = processTable[i].nextSlot){
+        if(awaitingRequest[i]){
+            Event candidate = {userReadyAt[i], UserEventOrder(i, EVENT_REQUEST), EVENT_REQUEST, i, processTable[i].pid};
+            if(!limited || EventAfter(*horizon, candidate)){
+                *horizon = candidate;
+                limited = true;
+            }
         }
     }
+    return limited;
 }
 
-// Checks if a specific process ID is present in the process table
-bool IsProcessPresent(ProcessControlBlock processTable[], int maxSimultaneousProcesses, pid_t pid){
-    for(int i = 0; i < maxSimultaneousProcesses; i++){
-        if(processTable[i].pid == pid){
-            return true;
+// Notes when the user in a slot will send its next request or exit: an in-process user takes its turn
+// then, and until a forked user's arrives the single-threaded loop holds back every later event
+void AwaitUser(int slot, long long readyAt){
+    userReadyAt[slot] = readyAt;
+    if(inProcessMode){
+        ScheduleEvent(EVENT_REQUEST, readyAt, slot, processTable[slot].pid);
+    } else if(workerCount == 1){
+        awaitingRequest[slot] = 1;
+    }
+}
+
+// Queues a request a forked user sent as an event at the time the user was ready to send it
+void ScheduleArrival(MessageBuffer* request){
+    int slot = GetProcessIndex(processTable, request->sender);
+    if(slot == -1){
+        return; // Sender has already been reaped
+    }
+    arrivedRequests[slot] = *request;
+    awaitingRequest[slot] = 0;
+    ScheduleEvent(EVENT_REQUEST, userReadyAt[slot], slot, request->sender);
+}
+
+// Launches the next child if one is due and a slot is free, then schedules the following launch
+void LaunchDueChild(){
+    if(numberOfChildren <= 0){
+        return;
+    }
+    if(!FindEmptyProcessSlot()){
+        launchWaitingForSlot = true;
+        return;
+    }
+    launchWaitingForSlot = false;
+    if(!AdmitLaunch()){
+        if(!launchWaitingForMemory){
+            launchesDelayed++;
+            LogPrintf(LOG_INFO, LOG_CAT_LAUNCH, "OSS: Delaying launch, working sets need %d of %d frames\n", MemoryDemand(), frameTableSize);
         }
+        launchWaitingForMemory = true;
+        return;
+    }
+    launchWaitingForMemory = false;
+    LogPrintf(LOG_INFO, LOG_CAT_LAUNCH, "OSS: Launching Child Process...\n");
+    numberOfChildren--;
+    LaunchProcess();
+    if(numberOfChildren > 0){
+        ScheduleEvent(EVENT_LAUNCH, SimulatedTime() + launchInterval);
     }
-    return false;
 }
 
-// Returns the index of a process in the table based on its PID
-int GetProcessIndex(ProcessControlBlock processTable[], int maxSimultaneousProcesses, pid_t pid){
-    for (int i = 0; i < maxSimultaneousProcesses; i++){
-        if (processTable[i].pid == pid){
-            return i;
+// Keeps reclaim passes coming on the simulated clock from the time the free pool drops below its low
+// watermark until it is back up to the high one
+void WakeReclaimer(){
+    if(ReclaimNeeded()){
+        reclaimActive = true;
+    } else if(ReclaimComplete()){
+        reclaimActive = false;
+    }
+    if(reclaimActive && !reclaimScheduled){
+        reclaimScheduled = true;
+        ScheduleEvent(EVENT_RECLAIM, SimulatedTime() + RECLAIM_INTERVAL);
+    }
+}
+
+// Swaps a process out: its frames are released, dirty ones written back, and it runs no more until resumed
+// Pages of the shared image other processes still map stay where they are
+void SuspendProcess(int i){
+    ProcessControlBlock* pcb = &processTable[i];
+    int resident = 0;
+    for(int page = 0; page < pagesPerProcess; page++){
+        int frame = pcb->pageTable[page];
+        if(frame != -1 && frameTable.mapCount[frame] == 1){
+            resident++;
+            if(TestFrameBit(frameTable.dirtyBits, frame)){
+                CountWriteBack(frame);
+            }
         }
     }
-    return -1;
+    ReleaseProcessFrames(pcb);
+    pcb->suspended = 1;
+    suspendedCount++;
+    suspensions++;
+    swappedOutPages += resident;
+    long long now = SimulatedTime();
+    LogPrintf(LOG_INFO, LOG_CAT_LAUNCH, "OSS: Suspending process %d (working set %d, %d pages swapped out) at time %d:%d\n", pcb->pid, workingSetSize[i].load(), resident, TimeSeconds(now), TimeNanoseconds(now));
 }
 
-// Send a message to a child process via message queue
-void SendMessageToProcess(MessageBuffer);
+// Runs one admission control check: swaps out the newest runnable process while the running working
+// sets exceed memory (keeping at least one running), otherwise resumes suspended processes oldest first
+// while they fit, and then retries a launch that was waiting for memory
+void CheckAdmission(){
+    std::vector<int> resumed;
+    {
+        std::unique_lock<std::shared_mutex> tableGuard(processTableLock);
+        int demand = MemoryDemand();
+        if(demand > peakMemoryDemand){
+            peakMemoryDemand = demand;
+        }
+        if(admissionSuspends && demand > frameTableSize && activeProcessCount - suspendedCount > 1){
+            for(int i = occupiedSlotTail; i != -1; i = processTable[i].prevSlot){
+                if(!processTable[i].suspended && !processTable[i].blocked){
+                    SuspendProcess(i);
+                    break;
+                }
+            }
+        } else {
+            for(int i = occupiedSlotHead; i != -1 && suspendedCount > 0; i = processTable[i].nextSlot){
+                if(!processTable[i].suspended){
+                    continue;
+                }
+                int size = workingSetSize[i];
+                size = (size >= 0) ? size : NewcomerWorkingSet();
+                if(demand + size > frameTableSize && activeProcessCount - suspendedCount > 0){
+                    break;
+                }
+                demand += size;
+                processTable[i].suspended = 0;
+                suspendedCount--;
+                long long now = SimulatedTime();
+                LogPrintf(LOG_INFO, LOG_CAT_LAUNCH, "OSS: Resuming process %d at time %d:%d\n", processTable[i].pid, TimeSeconds(now), TimeNanoseconds(now));
+                if(requestParked[i]){
+                    requestParked[i] = 0;
+                    long long parked = SimulatedTime() - slotMetrics[i].parkedAt;
+                    slotMetrics[i].blockedTime += parked;
+                    slotMetrics[i].parkedAt = -1;
+                    blockedTime += parked;
+                    UnblockProcess(&processTable[i]);
+                    resumed.push_back(i);
+                }
+            }
+        }
+    }
+    for(int i : resumed){
+        std::shared_lock<std::shared_mutex> tableGuard(processTableLock);
+        HandleBatchRequest(&parkedRequests[i]);
+    }
+    if(launchWaitingForMemory){
+        LaunchDueChild();
+    }
+    ScheduleEvent(EVENT_ADMISSION, SimulatedTime() + ADMISSION_INTERVAL);
+}
+
+// Paging device: one page-in is in service at a time and the rest wait in arrival order, served
+// either first-come first-served or by an elevator sweeping across the swap area
+struct DiskRequest {
+    int slot;
+    pid_t pid;
+    int memoryAddress;
+    int msgCode;
+    int block;           // Where the page lives in the swap area
+    long long queuedAt;  // Simulated ns when the fault was taken
+    MessageBuffer reply; // Sent to the process once the page is in
+    int next;
+};
+std::vector<DiskRequest> diskRequests; // Indexed by slot; a blocked process has one fault outstanding
+int diskQueueHead = -1;
+int diskQueueTail = -1;
+DiskRequest diskActive;    // Copied out of diskRequests so the slot can be reused while it is in service
+bool diskBusy = false;
+int diskHeadBlock = 0;
+int diskDirection = 1;     // Elevator sweep direction over swap blocks
+long long diskWriteDelay = 0; // Device time owed to dirty write-backs forced by completed faults
+long long diskReads = 0;
+
+// Unlinks and returns the next waiting request the scheduler picks, or -1 if none are waiting
+int TakeNextDiskRequest(){
+    if(diskQueueHead == -1){
+        return -1;
+    }
+    int chosen = diskQueueHead;
+    if(diskScheduler == DISK_ELEVATOR){
+        // Nearest block ahead of the head in the sweep direction, turning round when there is none
+        for(int pass = 0; pass < 2; pass++){
+            chosen = -1;
+            for(int r = diskQueueHead; r != -1; r = diskRequests[r].next){
+                int distance = (diskRequests[r].block - diskHeadBlock) * diskDirection;
+                if(distance >= 0 && (chosen == -1 || distance < (diskRequests[chosen].block - diskHeadBlock) * diskDirection)){
+                    chosen = r;
+                }
+            }
+            if(chosen != -1){
+                break;
+            }
+            diskDirection = -diskDirection;
+        }
+    }
+
+    int prev = -1;
+    for(int r = diskQueueHead; r != chosen; r = diskRequests[r].next){
+        prev = r;
+    }
+    if(prev == -1){
+        diskQueueHead = diskRequests[chosen].next;
+    } else {
+        diskRequests[prev].next = diskRequests[chosen].next;
+    }
+    if(diskQueueTail == chosen){
+        diskQueueTail = prev;
+    }
+    return chosen;
+}
 
-const int FRAME_TABLE_SIZE = 256;
-int memoryAccesses = 0;
-int pageFaults = 0;
+// Puts the next waiting page-in into service and schedules its completion
+void StartNextPageIn(){
+    if(diskBusy){
+        return;
+    }
+    std::unique_lock<std::mutex> guard(diskLock);
+    int r = TakeNextDiskRequest();
+    if(r == -1){
+        return;
+    }
+    diskActive = diskRequests[r];
+    guard.unlock();
+    diskBusy = true;
+    long long seek = (long long)abs(diskActive.block - diskHeadBlock) * DISK_SEEK_PER_BLOCK;
+    long long done = SimulatedTime() + diskWriteDelay + seek + diskLatency;
+    diskWriteDelay = 0;
+    diskHeadBlock = diskActive.block;
+    UpdateBlockedProcess(processTable, diskActive.pid, done);
+    ScheduleEvent(EVENT_DISK_DONE, done);
+}
 
-// Initializes the frame table to default values
-void InitializePageTable(PageTableEntry frameTable[]){
-    for(int i = 0; i < FRAME_TABLE_SIZE; i++){
-        frameTable[i].pid = 0;
-        frameTable[i].pageNumber = 0;
-        frameTable[i].secondChanceBit = 0;
-        frameTable[i].dirtyBit = 0;
+void QueuePageIn(int slot, int memoryAddress, int msgCode, MessageBuffer* reply){
+    std::unique_lock<std::mutex> guard(diskLock);
+    DiskRequest* request = &diskRequests[slot];
+    request->slot = slot;
+    request->pid = processTable[slot].pid;
+    request->memoryAddress = memoryAddress;
+    request->msgCode = msgCode;
+    // The shared image is read from its own blocks, ahead of every slot's swap area
+    int pageNumber = PageNumber(memoryAddress);
+    request->block = MapsSharedImage(slot, pageNumber) ? pageNumber : sharedPages + slot * pagesPerProcess + pageNumber;
+    request->queuedAt = SimulatedTime();
+    request->reply = *reply;
+    request->next = -1;
+    if(diskQueueTail == -1){
+        diskQueueHead = slot;
+    } else {
+        diskRequests[diskQueueTail].next = slot;
+    }
+    diskQueueTail = slot;
+    guard.unlock();
+
+    UpdateBlockedProcess(processTable, processTable[slot].pid, 0);
+    long long now = SimulatedTime();
+    LogPrintf(LOG_INFO, LOG_CAT_FAULT, "OSS: Address %d is not in a frame, pagefault; %d blocked on the paging device at time %d:%d\n", memoryAddress, processTable[slot].pid, TimeSeconds(now), TimeNanoseconds(now));
+    if(workerCount == 1){
+        StartNextPageIn();
+    } else {
+        WakeMainLoop(); // Worker mode starts page-ins from the main loop, which owns the timers
     }
 }
 
-// Displays the page table in the output file
-void DisplayPageTable(PageTableEntry frameTable[], int seconds, int nanoseconds, std::ostream& outputFile){
-    static int next_print_secs = 0;
-    static int next_print_nanos = 0;
+// Drops a waiting page-in for a process that has exited; one already in service is ignored on completion
+void CancelPageIn(int slot){
+    std::lock_guard<std::mutex> guard(diskLock);
+    int prev = -1;
+    for(int r = diskQueueHead; r != -1; r = diskRequests[r].next){
+        if(r == slot){
+            if(prev == -1){
+                diskQueueHead = diskRequests[r].next;
+            } else {
+                diskRequests[prev].next = diskRequests[r].next;
+            }
+            if(diskQueueTail == r){
+                diskQueueTail = prev;
+            }
+            return;
+        }
+        prev = r;
+    }
+}
 
-    if(seconds > next_print_secs || (seconds == next_print_secs && nanoseconds > next_print_nanos)){
-        std::cout << "OSS PID: " << getpid() << "  SysClockS: " << seconds << "  SysClockNano " << nanoseconds << "  \nPage Table:\n\tOwner PID\tPage Number\t2nd Chance Bit\tDirty Bit\n";
-        outputFile << "OSS PID: " << getpid() << "  SysClockS: " << seconds << "  SysClockNano " << nanoseconds << "  \nPage Table:\n\tOwner PID\tPage Number\t2nd Chance Bit\tDirty Bit\n";
-        for(int i = 0; i < FRAME_TABLE_SIZE; i++){
-            std::cout << "Frame " << std::to_string(i + 1) << ":\t" << std::to_string(frameTable[i].pid) << "\t" << std::to_string(frameTable[i].pageNumber) << "\t" << std::to_string(frameTable[i].secondChanceBit) << "\t" << std::to_string(frameTable[i].dirtyBit) << std::endl;
-            outputFile << std::to_string(i + 1) << "\t" << std::to_string(frameTable[i].pid) << "\t" << std::to_string(frameTable[i].pageNumber) << "\t" << std::to_string(frameTable[i].secondChanceBit) << "\t" << std::to_string(frameTable[i].dirtyBit) << std::endl;
+// Finishes the page-in in service: maps the page, wakes its process with the deferred reply and
+// starts the next request
+void CompletePageIn(){
+    std::shared_lock<std::shared_mutex> tableGuard(processTableLock);
+    diskBusy = false;
+    DiskRequest* request = &diskActive;
+    ProcessControlBlock* pcb = &processTable[request->slot];
+    if(pcb->isOccupied && pcb->pid == request->pid){
+        long long now = SimulatedTime();
+        RecordReference(request->pid, request->memoryAddress, request->msgCode, now);
+        long long writeBacks = pageWriteBacks;
+        int prefetched = prefetchedPages;
+        int frame = CompletePageFault(request->slot, request->memoryAddress, request->msgCode);
+        if(pageWriteBacks != writeBacks){
+            diskWriteDelay += diskLatency; // The evicted dirty page has to reach swap before the next read
         }
-        next_print_nanos = next_print_nanos + 500000000;
-        if (next_print_nanos >= 1000000000){
-            next_print_nanos = next_print_nanos - 1000000000;
-            next_print_secs++;
+        // Prepaged pages come in with the same read, each adding only its transfer time, which the
+        // faulting process waits out before its reply and the device before its next read
+        if(prefetchedPages != prefetched){
+            IncrementClock((prefetchedPages - prefetched) * DISK_TRANSFER_PER_PAGE);
+            now = SimulatedTime();
         }
+        diskReads++;
+        faultServiceTime += now - request->queuedAt;
+        UnblockProcess(pcb);
+        LogPrintf(LOG_INFO, LOG_CAT_FAULT, "OSS: Page-in of address %d for %d complete in frame %d, unblocking at time %d:%d\n", request->memoryAddress, request->pid, frame, TimeSeconds(now), TimeNanoseconds(now));
+        IncrementClock(UNBLOCK_AMOUNT);
+        // The process was blocked from queueing the fault until the reply goes out, unblock cost included
+        long long blocked = SimulatedTime() - request->queuedAt;
+        blockedTime += blocked;
+        slotMetrics[request->slot].blockedTime += blocked;
+        SendMessageToProcess(request->slot, request->reply);
+        WakeReclaimer();
     }
+    StartNextPageIn();
 }
 
-// Handles a page fault by selecting a victim frame and swapping pages
-void HandlePageFault(PageTableEntry frameTable[], std::ofstream* outputFile, pid_t pid, int pageNumber, int msgCode){
-    static int victimFrame = 0;
-    bool victimFound = false;
-
-    while(!victimFound){
-        if(frameTable[victimFrame].secondChanceBit == 1){
-            frameTable[victimFrame].secondChanceBit = 0;
-        } else {
-            victimFound = true;
-            if(frameTable[victimFrame].dirtyBit){
-                std::cout << "OSS: Swapping out dirty frame, saving to secondary storage..." << std::endl;
-                *outputFile << "OSS: Swapping out dirty frame, saving to secondary storage..." << std::endl;
+void RetireProcess(int, pid_t);
+void DispatchRequest(MessageBuffer*);
+void RunInProcessUser(int);
+void WriteCheckpoint();
+
+// Runs the work attached to an event
+void FireEvent(const Event& event){
+    switch(event.type){
+        case EVENT_LAUNCH:
+            LaunchDueChild();
+            break;
+        case EVENT_TABLE_DUMP: {
+            std::shared_lock<std::shared_mutex> tableGuard(processTableLock);
+            DisplayProcessTable(processTable, SimulatedTime());
+            DisplayPageTable(SimulatedTime());
+            ScheduleEvent(EVENT_TABLE_DUMP, event.due + TABLE_DUMP_INTERVAL);
+            break;
+        }
+        case EVENT_DISK_DONE:
+            CompletePageIn();
+            break;
+        case EVENT_ADMISSION:
+            CheckAdmission();
+            break;
+        case EVENT_RECLAIM: {
+            reclaimScheduled = false;
+            int freed = ReclaimFrames(RECLAIM_BATCH);
+            long long now = SimulatedTime();
+            LogPrintf(LOG_DEBUG, LOG_CAT_FAULT, "OSS: Reclaim freed %d frames, pool now %d at time %d:%d\n", freed, FreeFrameCount(), TimeSeconds(now), TimeNanoseconds(now));
+            WakeReclaimer();
+            break;
+        }
+        case EVENT_REQUEST:
+            if(!processTable[event.slot].isOccupied || processTable[event.slot].pid != event.pid){
+                break; // The user exited meanwhile
+            }
+            if(inProcessMode){
+                RunInProcessUser(event.slot);
+            } else {
+                DispatchRequest(&arrivedRequests[event.slot]);
+            }
+            break;
+        case EVENT_EXIT:
+            if(processTable[event.slot].isOccupied && processTable[event.slot].pid == event.pid){
+                RetireProcess(event.slot, event.pid);
+            }
+            if(launchWaitingForSlot){
+                LaunchDueChild();
             }
+            break;
+        case EVENT_CHECKPOINT:
+            WriteCheckpoint();
+            ScheduleEvent(EVENT_CHECKPOINT, event.due + checkpointInterval);
+            break;
+    }
+}
+
+// Releases everything a terminated process held and frees its slot
+void RetireProcess(int i, pid_t pid){
+    std::unique_lock<std::shared_mutex> tableGuard(processTableLock);
+    if(transport == TRANSPORT_RING && !inProcessMode){
+        childIpcSyscalls += channels[i].childSyscalls.load();
+    }
+    CancelPageIn(i);
+    awaitingRequest[i] = 0;
+    if(processTable[i].suspended){
+        processTable[i].suspended = 0;
+        suspendedCount--;
+    }
+    if(workingSetWindow > 0 && requestParked[i]){
+        requestParked[i] = 0;
+        slotMetrics[i].blockedTime += SimulatedTime() - slotMetrics[i].parkedAt;
+        blockedTime += SimulatedTime() - slotMetrics[i].parkedAt;
+    }
+    finishedMetrics.push_back(SnapshotProcessMetrics(i));
+    finishedMetrics.back().endedAt = SimulatedTime();
+    RemoveProcessFromTable(processTable, pid);
+    if(recordingTrace){
+        AppendTraceRecord(pid, 0, TRACE_EXIT, SimulatedTime());
+    }
+}
+
+// Reaps every child that has exited since the last SIGCHLD was read from the signalfd; returns the
+// number whose exit was queued as an event
+int ReapChildren(){
+    struct signalfd_siginfo info;
+    if(read(sigchldFd, &info, sizeof(info)) != sizeof(info)){
+        return 0; // No SIGCHLD pending
+    }
+    int reaped = 0;
+    while(read(sigchldFd, &info, sizeof(info)) == sizeof(info)){
+    }
 
-            frameTable[victimFrame].pid = pid;
-            frameTable[victimFrame].pageNumber = pageNumber;
-            frameTable[victimFrame].secondChanceBit = 1;
-            frameTable[victimFrame].dirtyBit = (msgCode == MSG_WRITE) ? 1 : 0;
+    pid_t pid;
+    while((pid = waitpid((pid_t)-1, nullptr, WNOHANG)) > 0){
+        LogPrintf(LOG_INFO, LOG_CAT_LAUNCH, "OSS: Receiving child %d has terminated! Releasing childs' resources...\n", pid);
+
+        int i = GetProcessIndex(processTable, pid);
+
+        if(i != -1 && processTable[i].isOccupied){
+            if(workerCount == 1){
+                // The exit takes effect when the user would have sent its next request
+                awaitingRequest[i] = 0;
+                ScheduleEvent(EVENT_EXIT, userReadyAt[i], i, pid);
+                reaped++;
+            } else {
+                RetireProcess(i, pid);
+            }
+        }
+    }
+    if(launchWaitingForSlot){
+        LaunchDueChild();
+    }
+    return reaped;
+}
 
-            MessageBuffer buf;
-            buf.mtype = pid;
-            buf.sender = getpid();
-            buf.memoryAddress = pageNumber;
-            buf.msgCode = MSG_GRANTED;
-            memoryAccesses++;
-            SendMessageToProcess(buf);
+// Handles one request received from a child
+void DispatchRequest(MessageBuffer* rcvbuf){
+    if(workerCount > 1){
+        // Workers serve requests as they come rather than as events, but not before their senders were ready
+        int slot = GetProcessIndex(processTable, rcvbuf->sender);
+        if(slot != -1){
+            AdvanceClockTo(userReadyAt[slot]);
+        }
+    }
+    if(rcvbuf->msgCode == MSG_BATCH){
+        long long now = SimulatedTime();
+        LogPrintf(LOG_INFO, LOG_CAT_REQUEST, "OSS: %d requesting read/write of %d addresses starting at %d at time %d:%d\n", rcvbuf->sender, rcvbuf->count, rcvbuf->references[0].memoryAddress, TimeSeconds(now), TimeNanoseconds(now));
+        if(transport == TRANSPORT_MSGQ && !inProcessMode){
+            childIpcSyscalls += 2; // The child's msgsnd and the msgrcv of its reply
         }
-        victimFrame++;
-        if(victimFrame == FRAME_TABLE_SIZE){
-            victimFrame = 0;
+        HandleBatchRequest(rcvbuf);
+        if(workerCount == 1){
+            WakeReclaimer(); // Worker mode leaves timers to the main loop
         }
     }
+    long long due = mainNextEventDue.load();
+    if(workerCount > 1 && due != -1 && SimulatedTime() >= due){
+        WakeMainLoop();
+    }
 }
 
-// Increment the system clock
-void IncrementClock(SystemClock* c, int increment_amount){
-    c->nanoseconds = c->nanoseconds + increment_amount;
-    if (c->nanoseconds >= 1e9){
-        c->nanoseconds -= 1e9;
-        c->seconds++;
+// Gives an in-process user its turn: it takes its last reply, tops its batch up and hands it straight
+// to the dispatcher, or exits once it has nothing left to send. A user blocked on the paging device
+// gets its reply, and its next turn, when the page-in completes
+void RunInProcessUser(int i){
+    InProcessUser* user = &inProcessUsers[i];
+    SlotStats* stats = ControlSlotStats(control, i);
+    if(stats->requests.load(std::memory_order_relaxed) > 0){
+        NoteReplyReceived(stats, &user->reply, user->sentAt);
+    }
+    ApplyReply(&user->request, &user->reply);
+    int carried = user->request.count;
+    if(FillBatch(&user->state, &user->request, batchSize)){
+        LogPrintf(LOG_INFO, LOG_CAT_LAUNCH, "OSS: In-process user %d randomly terminating...\n", user->state.pid);
+    }
+    if(user->request.count == 0){
+        RetireProcess(i, user->state.pid);
+        if(launchWaitingForSlot){
+            LaunchDueChild();
+        }
+        return;
     }
+    NoteBatchSent(stats, &user->request, carried);
+    user->sentAt = std::chrono::steady_clock::now();
+    DispatchRequest(&user->request);
 }
 
-// Handles page requests from processes
-void HandlePageRequest(PageTableEntry frameTable[], std::ofstream* outputFile, SystemClock* c, pid_t pid, int memoryAddress, int msgCode){
+// Blocks until a child exits or rings the doorbell; returns true if a request was received instead
+bool WaitForEvents(MessageBuffer* rcvbuf){
+    doorbell->ossWaiting.store(1);
+    // A request published before the flag was visible would not ring the doorbell, so look once more
+    if(ReceiveRequest(rcvbuf, 0)){
+        doorbell->ossWaiting.store(0);
+        return true;
+    }
 
-    MessageBuffer buf;
-    buf.mtype = pid;
-    buf.sender = getpid();
-    buf.memoryAddress = memoryAddress;
-    int pageNumber = memoryAddress/1024;
+    struct epoll_event events[2];
+    int ready = epoll_wait(epollFd, events, 2, -1);
+    ipcSyscalls++;
+    doorbell->ossWaiting.store(0);
+    for(int i = 0; i < ready; i++){
+        if(events[i].data.fd == wakeFd){
+            uint64_t count;
+            read(wakeFd, &count, sizeof(count));
+        }
+    }
+    return false;
+}
 
+// Serves one request from a worker's share of the slots; returns false if none was waiting
+bool ServeOneRequest(MessageBuffer* rcvbuf, int worker){
+    std::shared_lock<std::shared_mutex> tableGuard(processTableLock);
+    if(!ReceiveRequest(rcvbuf, worker)){
+        return false;
+    }
+    DispatchRequest(rcvbuf);
+    return true;
+}
 
-    for (int i = 0; i < FRAME_TABLE_SIZE; i++){
-        if(frameTable[i].pid == pid && frameTable[i].pageNumber == pageNumber){
+// Body of a worker thread: serves requests until oss shuts down, sleeping on the doorbell when idle
+void WorkerLoop(int worker){
+    MessageBuffer rcvbuf;
+    while(workersRunning.load()){
+        if(ServeOneRequest(&rcvbuf, worker)){
+            continue;
+        }
+        doorbell->ossWaiting.fetch_add(1);
+        // A request published before the flag was visible would not ring the doorbell, so look once more
+        if(!ServeOneRequest(&rcvbuf, worker)){
+            struct pollfd wake = {wakeFd, POLLIN, 0};
+            if(poll(&wake, 1, WORKER_IDLE_TIMEOUT_MS) > 0){
+                uint64_t count;
+                read(wakeFd, &count, sizeof(count));
+            }
+            ipcSyscalls++;
+        }
+        doorbell->ossWaiting.fetch_sub(1);
+    }
+}
 
-            if(msgCode == MSG_WRITE)
-                frameTable[i].dirtyBit = 1;
-            frameTable[i].secondChanceBit = 1;
-            IncrementClock(c, 100);
+// Starts the worker threads with SIGALRM and SIGINT blocked, so those reach the main thread
+void StartWorkers(){
+    sigset_t mask, previous;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGALRM);
+    sigaddset(&mask, SIGINT);
+    pthread_sigmask(SIG_BLOCK, &mask, &previous);
+    workersRunning.store(true);
+    for(int w = 0; w < workerCount; w++){
+        workers.emplace_back(WorkerLoop, w);
+    }
+    pthread_sigmask(SIG_SETMASK, &previous, nullptr);
+}
 
-            buf.msgCode = MSG_GRANTED;
-            memoryAccesses++;
-            SendMessageToProcess(buf);
-            return;
+// Stops the worker threads and waits for each to finish its current request
+void StopWorkers(){
+    workersRunning.store(false);
+    for(std::thread& worker : workers){
+        if(worker.get_id() != std::this_thread::get_id()){
+            worker.join();
+        } else {
+            worker.detach();
         }
     }
+    workers.clear();
+}
 
-    buf.msgCode = MSG_BLOCKED;
-    SendMessageToProcess(buf);
-    HandlePageFault(frameTable, outputFile, pid, pageNumber, msgCode);
-    pageFaults++;
+// Returns true if a page-in is queued but the paging device has not started it yet
+bool PageInWaiting(){
+    std::lock_guard<std::mutex> guard(diskLock);
+    return !diskBusy && diskQueueHead != -1;
 }
 
-// Adds specified nanoseconds to the provided time, adjusting seconds if necessary
-void timeAddition(int *addend1Secs, int *addend1Nanos, int addend2Nanos){
-    *addend1Nanos += addend2Nanos;
-    if (*addend1Nanos >= 1e9){
-        *addend1Nanos -= 1e9;
-        *addend1Secs++;
+pid_t ForkUser(int, uint64_t, bool);
+
+// Writes a histogram's buckets and totals into a checkpoint
+void SaveHistogram(StateWriter* out, const LatencyHistogram* histogram){
+    for(int b = 0; b < HISTOGRAM_BUCKETS; b++){
+        out->Put(histogram->buckets[b].load());
     }
+    out->Put(histogram->count.load());
+    out->Put(histogram->total.load());
+    out->Put(histogram->max.load());
 }
 
-// Generates a random number using a seed modifier for process-specific randomness
-int GenerateRandomNumber(int min, int max, int pid) {
-    unsigned seed = std::chrono::system_clock::now().time_since_epoch().count() * pid;
-    std::default_random_engine generator(seed);
-    std::uniform_int_distribution<int> distribution(min, max);
-    int random_number = distribution(generator);
-    return random_number;
+bool LoadHistogram(StateReader* in, LatencyHistogram* histogram){
+    uint64_t values[HISTOGRAM_BUCKETS + 3];
+    if(!in->GetArray(values, HISTOGRAM_BUCKETS + 3)){
+        return false;
+    }
+    for(int b = 0; b < HISTOGRAM_BUCKETS; b++){
+        histogram->buckets[b].store(values[b]);
+    }
+    histogram->count = values[HISTOGRAM_BUCKETS];
+    histogram->total = values[HISTOGRAM_BUCKETS + 1];
+    histogram->max = values[HISTOGRAM_BUCKETS + 2];
+    return true;
 }
 
+// Saves the options a resumed run takes from the checkpoint rather than its command line, beyond the
+// pager configuration the checkpoint's header holds
+void SaveRunConfig(StateWriter* out){
+    out->Put(numberOfChildren);
+    out->Put(launchInterval);
+    out->Put(batchSize);
+    out->Put(diskLatency);
+    out->Put(diskScheduler);
+    out->PutVector(std::vector<char>(workloadName.begin(), workloadName.end()));
+    out->Put(readPercent);
+    out->Put(runSeed);
+    out->Put(workingSetWindow);
+    out->Put(admissionSuspends);
+}
 
-void LaunchProcess(ProcessControlBlock[], int);
-bool IsLaunchIntervalMet(int);
-void HandleTimeout(int);
-void HandleInterrupt(int);
-void CleanupSystem(std::string);
-void OutputStats(double);
+// Configures the run from a checkpoint, overriding the options; returns false if it has no usable configuration
+bool ApplyCheckpointConfig(const Checkpoint* checkpoint, string* policyName){
+    const CheckpointHeader* header = checkpoint->header;
+    ReplacementPolicy* check = CreateReplacementPolicy(header->policy);
+    if(check == nullptr || header->shards != 1 || !SetPageGeometry(header->pageSize, header->pagesPerProcess)
+       || !SetSharedPages(header->sharedPages)){
+        delete check;
+        return false;
+    }
+    delete check;
+    *policyName = header->policy;
+    frameTableSize = header->frames;
+    maxSimultaneousProcesses = header->slots;
+    prefetchMode = header->prefetchMode;
+    prefetchPages = header->prefetchPages;
+    tlbEntries = header->tlbEntries;
+    tlbWays = header->tlbWays;
+    tlbSets = (tlbWays > 0) ? tlbEntries / tlbWays : 0;
+    tlbReplacement = header->tlbReplacement;
+    freeLowWatermark = header->freeLowWatermark;
+    freeHighWatermark = header->freeHighWatermark;
+
+    size_t size;
+    const void* run = CheckpointSectionData(checkpoint, SECTION_RUN, &size);
+    if(run == nullptr){
+        return false;
+    }
+    StateReader in(run, size);
+    std::vector<char> name;
+    if(!(in.Get(&numberOfChildren) && in.Get(&launchInterval) && in.Get(&batchSize) && in.Get(&diskLatency) &&
+         in.Get(&diskScheduler) && in.GetVector(&name) && in.Get(&readPercent) && in.Get(&runSeed) &&
+         in.Get(&workingSetWindow) && in.Get(&admissionSuspends))){
+        return false;
+    }
+    workloadName.assign(name.begin(), name.end());
+    return ParseWorkload(workloadName.c_str(), &workload);
+}
 
-// Signal handling global
-volatile sig_atomic_t term = 0;
+// Saves the simulation around the pager: clock, pending events, process table lists, users, metrics,
+// paging device and admission control. Checkpoint events are left out; a resumed run schedules its own
+void SaveSimulationState(StateWriter* out){
+    std::vector<Event> events;
+    for(const Event& event : eventQueue){
+        if(event.type != EVENT_CHECKPOINT){
+            events.push_back(event);
+        }
+    }
+    out->Put(SimulatedTime());
+    out->Put(eventsScheduled);
+    out->Put(eventsFired);
+    out->PutVector(events);
+    out->Put(launchCount);
+    out->Put(nextInProcessPid);
+    out->Put(freeSlotHead);
+    out->Put(occupiedSlotHead);
+    out->Put(occupiedSlotTail);
+    out->PutVector(userReadyAt);
+    out->PutVector(userProgress);
+    for(int i = 0; i < maxSimultaneousProcesses; i++){
+        SlotStats* stats = ControlSlotStats(control, i);
+        uint64_t counters[] = {stats->requests.load(), stats->references.load(), stats->writes.load(),
+                               stats->blockedReplies.load(), stats->waitTime.load()};
+        out->PutArray(counters, 5);
+    }
+    out->PutVector(slotMetrics);
+    out->PutVector(finishedMetrics);
+    out->PutVector(requestStartedAt);
+    SaveHistogram(out, &simulatedLatency);
+    SaveHistogram(out, &wallLatency);
+    out->Put(faultServiceTime);
+    out->Put(blockedTime);
+    out->Put(diskReads);
+    out->Put(diskWriteDelay);
+    out->PutVector(diskRequests);
+    out->Put(diskQueueHead);
+    out->Put(diskQueueTail);
+    out->Put(diskActive);
+    out->Put(diskBusy);
+    out->Put(diskHeadBlock);
+    out->Put(diskDirection);
+    out->Put(launchWaitingForSlot);
+    out->Put(reclaimActive);
+    out->Put(reclaimScheduled);
+    out->Put(ipcSyscalls.load());
+    out->Put(childIpcSyscalls.load());
+    if(workingSetWindow > 0){
+        out->PutVector(workingSetBits);
+        out->PutVector(workingSetReferences);
+        for(int i = 0; i < maxSimultaneousProcesses; i++){
+            out->Put(workingSetSize[i].load());
+        }
+        out->Put(workingSetSampleTotal.load());
+        out->Put(workingSetSamples.load());
+        out->PutVector(parkedRequests);
+        out->PutVector(requestParked);
+        out->Put(suspendedCount);
+        out->Put(launchWaitingForMemory);
+        out->Put(launchesDelayed);
+        out->Put(suspensions);
+        out->Put(swappedOutPages);
+        out->Put(peakMemoryDemand);
+    }
+}
 
-// Global structures for process and page tables (not shared memory)
-struct ProcessControlBlock processTable[20];
-struct PageTableEntry frameTable[FRAME_TABLE_SIZE]; // Frame table size fixed at 256
+bool LoadSimulationState(StateReader* in){
+    int slots = maxSimultaneousProcesses;
+    long long time, ipc, childIpc;
+    if(!(in->Get(&time) && in->Get(&eventsScheduled) && in->Get(&eventsFired) && in->GetVector(&eventQueue) &&
+         in->Get(&launchCount) && in->Get(&nextInProcessPid) && in->Get(&freeSlotHead) && in->Get(&occupiedSlotHead) &&
+         in->Get(&occupiedSlotTail) && in->GetVector(&userReadyAt, slots) && in->GetVector(&userProgress, slots))){
+        return false;
+    }
+    for(int i = 0; i < slots; i++){
+        uint64_t counters[5];
+        if(!in->GetArray(counters, 5)){
+            return false;
+        }
+        SlotStats* stats = ControlSlotStats(control, i);
+        ResetSlotStats(stats, processTable[i].isOccupied ? processTable[i].pid : 0);
+        stats->requests.store(counters[0]);
+        stats->references.store(counters[1]);
+        stats->writes.store(counters[2]);
+        stats->blockedReplies.store(counters[3]);
+        stats->waitTime.store(counters[4]);
+    }
+    if(!(in->GetVector(&slotMetrics, slots) && in->GetVector(&finishedMetrics) && in->GetVector(&requestStartedAt, slots) &&
+         LoadHistogram(in, &simulatedLatency) && LoadHistogram(in, &wallLatency) && in->Get(&faultServiceTime) &&
+         in->Get(&blockedTime) && in->Get(&diskReads) && in->Get(&diskWriteDelay) && in->GetVector(&diskRequests, slots) &&
+         in->Get(&diskQueueHead) && in->Get(&diskQueueTail) && in->Get(&diskActive) && in->Get(&diskBusy) &&
+         in->Get(&diskHeadBlock) && in->Get(&diskDirection) && in->Get(&launchWaitingForSlot) && in->Get(&reclaimActive) &&
+         in->Get(&reclaimScheduled) && in->Get(&ipc) && in->Get(&childIpc))){
+        return false;
+    }
+    ipcSyscalls = ipc;
+    childIpcSyscalls = childIpc;
+    if(workingSetWindow > 0){
+        long long sampleTotal, samples;
+        if(!(in->GetVector(&workingSetBits, (long long)slots * workingSetWords) && in->GetVector(&workingSetReferences, slots))){
+            return false;
+        }
+        for(int i = 0; i < slots; i++){
+            int size;
+            if(!in->Get(&size)){
+                return false;
+            }
+            workingSetSize[i].store(size);
+        }
+        if(!(in->Get(&sampleTotal) && in->Get(&samples) && in->GetVector(&parkedRequests, slots) &&
+             in->GetVector(&requestParked, slots) && in->Get(&suspendedCount) && in->Get(&launchWaitingForMemory) &&
+             in->Get(&launchesDelayed) && in->Get(&suspensions) && in->Get(&swappedOutPages) && in->Get(&peakMemoryDemand))){
+            return false;
+        }
+        workingSetSampleTotal = sampleTotal;
+        workingSetSamples = samples;
+    }
+    std::make_heap(eventQueue.begin(), eventQueue.end(), EventAfter);
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    requestStartedWall.assign(slots, now);
+    clockTime.store(time);
+    PublishClock(time);
+    return true;
+}
+
+// Writes everything needed to resume the run to the checkpoint file; only ever called between events
+void WriteCheckpoint(){
+    StateWriter pager, policies, tlb, run, simulation;
+    CheckpointWriter writer;
+    CheckpointBegin(&writer, SimulatedTime());
+    CheckpointAddPager(&writer, &pager, &policies, &tlb);
+    SaveRunConfig(&run);
+    CheckpointAddSection(&writer, SECTION_RUN, run.bytes.data(), run.bytes.size());
+    SaveSimulationState(&simulation);
+    CheckpointAddSection(&writer, SECTION_SIMULATION, simulation.bytes.data(), simulation.bytes.size());
+    long long now = SimulatedTime();
+    if(!CheckpointWrite(&writer, checkpointPath.c_str())){
+        perror("Error: unable to write checkpoint");
+        return;
+    }
+    checkpointsWritten++;
+    LogPrintf(LOG_INFO, LOG_CAT_GENERAL, "OSS: Checkpoint written to %s at time %d:%d\n", checkpointPath.c_str(), TimeSeconds(now), TimeNanoseconds(now));
+}
+
+// Moves the process in a slot to a new pid everywhere the old one is recorded: the pid index, a page-in
+// it waits for, a parked request, its counters and the replacement policy's history
+void RenameUser(int i, pid_t pid){
+    pid_t old = processTable[i].pid;
+    int* link = &pidBuckets[PidBucket(old)];
+    while(*link != i){
+        link = &processTable[*link].nextInBucket;
+    }
+    *link = processTable[i].nextInBucket;
+    processTable[i].pid = pid;
+    int bucket = PidBucket(pid);
+    processTable[i].nextInBucket = pidBuckets[bucket];
+    pidBuckets[bucket] = i;
+    if(diskRequests[i].pid == old){
+        diskRequests[i].pid = pid;
+        diskRequests[i].reply.mtype = pid;
+    }
+    if(diskBusy && diskActive.slot == i && diskActive.pid == old){
+        diskActive.pid = pid;
+        diskActive.reply.mtype = pid;
+    }
+    if(workingSetWindow > 0 && requestParked[i]){
+        parkedRequests[i].sender = pid;
+    }
+    slotMetrics[i].pid = pid;
+    ControlSlotStats(control, i)->pid.store(pid, std::memory_order_relaxed);
+    for(int s = 0; s < frameShardCount; s++){
+        frameShards[s].policy->RenamePid(old, pid);
+    }
+}
+
+// Puts a user back in every occupied slot exactly where the checkpointed one was: an in-process user is
+// regenerated from its seed, and a forked one relaunched to do the same under a new pid. Turns and
+// arrivals that were pending are scheduled afresh, since a relaunched user sends its request again
+void RestoreUsers(){
+    eventQueue.erase(std::remove_if(eventQueue.begin(), eventQueue.end(), [](const Event& event){
+        return event.type == EVENT_REQUEST || event.type == EVENT_EXIT;
+    }), eventQueue.end());
+    std::make_heap(eventQueue.begin(), eventQueue.end(), EventAfter);
+    awaitingRequest.assign(maxSimultaneousProcesses, 0);
+    for(int i = occupiedSlotHead; i != -1; i = processTable[i].nextSlot){
+        UserProgress* progress = &userProgress[i];
+        uint64_t seed = WorkloadSeed(runSeed, i, slotMetrics[i].launch);
+        if(inProcessMode){
+            InProcessUser* user = &inProcessUsers[i];
+            InitializeUser(&user->state, &user->request, processTable[i].pid, getpid(), pageSize, pagesPerProcess, &workload,
+                           readPercent, seed);
+            SkipReferences(&user->state, progress->generated);
+            user->request.count = progress->request.count;
+            memcpy(user->request.references, progress->request.references, progress->request.count * sizeof(MemoryReference));
+            user->reply.count = 0;
+            user->sentAt = std::chrono::steady_clock::now();
+        } else {
+            SlotResume* resume = ControlSlotResume(control, i);
+            resume->generated = progress->generated;
+            resume->outstanding = progress->outstanding;
+            // A batch the old user sent that was never handled was counted by it; its successor resends it
+            resume->counted = !progress->outstanding && (long long)ControlSlotStats(control, i)->requests.load() > slotMetrics[i].requests;
+            resume->batch = progress->request;
+            RenameUser(i, ForkUser(i, seed, true));
+        }
+        if(!progress->outstanding){
+            AwaitUser(i, userReadyAt[i]);
+        }
+    }
+}
+
+// Restores the run from a checkpoint into tables allocated for its configuration; returns false if it
+// does not fit them
+bool RestoreSimulation(const Checkpoint* checkpoint){
+    if(!RestorePager(checkpoint)){
+        return false;
+    }
+    size_t size = 0;
+    const void* simulation = CheckpointSectionData(checkpoint, SECTION_SIMULATION, &size);
+    StateReader in(simulation, size);
+    if(simulation == nullptr || !LoadSimulationState(&in)){
+        return false;
+    }
+    for(int i = occupiedSlotHead; i != -1; i = processTable[i].nextSlot){
+        int bucket = PidBucket(processTable[i].pid);
+        processTable[i].nextInBucket = pidBuckets[bucket];
+        pidBuckets[bucket] = i;
+        activeProcessCount++;
+        if(processTable[i].blocked){
+            blockedProcessCount++;
+        }
+    }
+    RestoreUsers();
+    return true;
+}
 
-// Global variables for system management
-SystemClock* shm_clock;
-key_t clock_key = ftok("/tmp", 35);
-int shmtid = shmget(clock_key, sizeof(SystemClock), IPC_CREAT | 0666);
-std::ofstream outputFile;
-int msgqid;
-int maxSimultaneousProcesses = 1;
-int successfulTerminations = 0;
 std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
 
 // Main function with argument parsing and system initialization
 int main(int argc, char** argv){
-    int option, numberOfChildren = 1, launchInterval = 100;
-    int totalChildren;
-    double totalBlockedTime = 0, totalCPUTime = 0, totalTimeInSystem = 0;
+    int option;
     string logFileName = "logFileName.txt";
-    while ( (option = getopt(argc, argv, "hn:s:i:f:")) != -1) {
+    int logLevel = LOG_INFO;
+    int logCategories = LOG_CAT_ALL;
+    bool watermarksSet = false;
+    bool seedSet = false;
+    ParseWorkload(DEFAULT_WORKLOAD, &workload);
+    string traceFileName = "";
+    string policyName = "clock";
+    string resumePath = "";
+    Checkpoint resume;
+    int sharedImagePages = 0;
+    while ( (option = getopt(argc, argv, "hn:s:i:f:b:T:ql:C:r:P:w:d:D:j:E:g:H:W:R:S:L:a:A:o:c:k:")) != -1) {
         switch(option) {
             case 'h':
                 printf(" [-n proc] [-s simul] [-t timelimitForChildren]\n"
- "[-i intervalInMsToLaunchChildren] [-f logFileName]");
+ "[-i intervalInMsToLaunchChildren] [-f logFileName] [-b referencesPerBatch]\n"
+ "[-T msgq|ring] [-q] [-l logLevel 0-2] [-C general,launch,request,fault,table,report]\n"
+ "[-r traceFileToRecord] [-P fifo|clock|nru|aging|wsclock|clockpro|arc]\n"
+ "[-w lowWatermark,highWatermark (free frames, 0 disables reclaim)]\n"
+ "[-d pagingDeviceLatencyMs (0 for instant faults)] [-D fifo|elevator] [-j workerThreads]\n"
+ "[-E process|inproc (run users as forked ./user processes or inside oss)]\n"
+ "[-g frames[,pageSize[,pagesPerProcess]] (default 256,1024,64)]\n"
+ "[-H sharedPages (the first pages of every address space map one image shared copy-on-write, default 0)]\n"
+ "[-W uniform|zipf[:skew]|phase[:pages[:references]]|scan[:referencesPerPage]|loop[:pages], or a mix such as zipf+scan]\n"
+ "[-R readPercent (default 85)] [-S seed (reproduces a run's reference streams)]\n"
+ "[-L tlbEntries[,ways[,lru|fifo|random]] (per-process TLB, 0 for none)]\n"
+ "[-a off|cluster[:pages]|readahead[:maxPages] (prepaging on faults, default off)]\n"
+ "[-A workingSetWindow[,suspend] (admission control, window in references; 0 for none)]\n"
+ "[-o reportPrefix (also write the final report to reportPrefix.json and reportPrefix.csv)]\n"
+ "[-c checkpointFile[,intervalMs] (checkpoint every intervalMs simulated, default 1000, 0 for only on a signal)]\n"
+ "[-k checkpointFile (resume from a checkpoint, which supplies every simulation option)]\n");
                 return 0;
                 break;
             case 'n':
                 numberOfChildren = atoi(optarg);
-                totalChildren = numberOfChildren;
                 break;
             case 's':
                 maxSimultaneousProcesses = atoi(optarg);
+                if(maxSimultaneousProcesses < 1){
+                    std::cerr << "Error: at least one simultaneous process is needed" << std::endl;
+                    return 1;
+                }
                 break;
             case 'i':
                 launchInterval = (1000000 * atoi(optarg));
@@ -392,22 +1747,282 @@ int main(int argc, char** argv){
             case 'f':
                 logFileName = optarg;
                 break;
+            case 'b':
+                batchSize = atoi(optarg);
+                if(batchSize < 1 || batchSize > MAX_BATCH_SIZE){
+                    std::cerr << "Error: batch size must be between 1 and " << MAX_BATCH_SIZE << std::endl;
+                    return 1;
+                }
+                break;
+            case 'T':
+                if(strcmp(optarg, "msgq") == 0){
+                    transport = TRANSPORT_MSGQ;
+                } else if(strcmp(optarg, "ring") == 0){
+                    transport = TRANSPORT_RING;
+                } else {
+                    std::cerr << "Error: transport must be msgq or ring" << std::endl;
+                    return 1;
+                }
+                break;
+            case 'q':
+                logCategories = LOG_CAT_REPORT; // Benchmark mode: nothing but the final report
+                break;
+            case 'l':
+                logLevel = atoi(optarg);
+                if(logLevel < LOG_ERROR || logLevel > LOG_DEBUG){
+                    std::cerr << "Error: log level must be 0 (errors), 1 (info) or 2 (debug)" << std::endl;
+                    return 1;
+                }
+                break;
+            case 'C':
+                logCategories = LogParseCategories(optarg);
+                if(logCategories == -1){
+                    std::cerr << "Error: unknown log category in " << optarg << std::endl;
+                    return 1;
+                }
+                logCategories |= LOG_CAT_REPORT;
+                break;
+            case 'r':
+                traceFileName = optarg;
+                break;
+            case 'w':
+                freeHighWatermark = 0;
+                if(sscanf(optarg, "%d,%d", &freeLowWatermark, &freeHighWatermark) < 1 || freeHighWatermark < freeLowWatermark){
+                    freeHighWatermark = freeLowWatermark;
+                }
+                watermarksSet = true;
+                break;
+            case 'd':
+                diskLatency = 1000000LL * atoi(optarg);
+                if(diskLatency < 0){
+                    std::cerr << "Error: paging device latency cannot be negative" << std::endl;
+                    return 1;
+                }
+                break;
+            case 'D':
+                if(strcmp(optarg, "fifo") == 0){
+                    diskScheduler = DISK_FIFO;
+                } else if(strcmp(optarg, "elevator") == 0){
+                    diskScheduler = DISK_ELEVATOR;
+                } else {
+                    std::cerr << "Error: paging device scheduler must be fifo or elevator" << std::endl;
+                    return 1;
+                }
+                break;
+            case 'P': {
+                // OPT needs the future reference stream, which only replay has
+                ReplacementPolicy* check = (strcmp(optarg, "opt") == 0) ? nullptr : CreateReplacementPolicy(optarg);
+                if(check == nullptr){
+                    std::cerr << "Error: unknown replacement policy " << optarg << " (opt is only available in replay)" << std::endl;
+                    return 1;
+                }
+                delete check;
+                policyName = optarg;
+                break;
+            }
+            case 'E':
+                if(strcmp(optarg, "process") == 0){
+                    inProcessMode = false;
+                } else if(strcmp(optarg, "inproc") == 0){
+                    inProcessMode = true;
+                } else {
+                    std::cerr << "Error: execution mode must be process or inproc" << std::endl;
+                    return 1;
+                }
+                break;
+            case 'g':
+                if(!ParseGeometry(optarg)){
+                    std::cerr << "Error: geometry must be frames[,pageSize[,pagesPerProcess]] with a power-of-two page size"
+                              << " and at most " << MAX_ADDRESS_SPACE << " bytes per process" << std::endl;
+                    return 1;
+                }
+                break;
+            case 'H':
+                sharedImagePages = atoi(optarg);
+                break;
+            case 'W':
+                if(!ParseWorkload(optarg, &workload)){
+                    std::cerr << "Error: unknown workload " << optarg << std::endl;
+                    return 1;
+                }
+                workloadName = optarg;
+                break;
+            case 'R':
+                readPercent = atoi(optarg);
+                if(readPercent < 0 || readPercent > 100){
+                    std::cerr << "Error: read percentage must be between 0 and 100" << std::endl;
+                    return 1;
+                }
+                break;
+            case 'A': {
+                char suspend[16] = "";
+                if(sscanf(optarg, "%d,%15s", &workingSetWindow, suspend) < 1 || workingSetWindow < 0
+                   || (suspend[0] != '\0' && strcmp(suspend, "suspend") != 0)){
+                    std::cerr << "Error: admission control must be workingSetWindow[,suspend]" << std::endl;
+                    return 1;
+                }
+                admissionSuspends = suspend[0] != '\0';
+                break;
+            }
+            case 'a':
+                if(!ParsePrefetch(optarg)){
+                    std::cerr << "Error: prepaging must be off, cluster[:pages] or readahead[:maxPages]" << std::endl;
+                    return 1;
+                }
+                break;
+            case 'L':
+                if(!ParseTlb(optarg)){
+                    std::cerr << "Error: TLB must be entries[,ways[,lru|fifo|random]] with ways dividing entries" << std::endl;
+                    return 1;
+                }
+                break;
+            case 'o':
+                reportPrefix = optarg;
+                break;
+            case 'c': {
+                checkpointPath = optarg;
+                size_t comma = checkpointPath.rfind(',');
+                if(comma != string::npos){
+                    checkpointInterval = 1000000LL * atoi(checkpointPath.c_str() + comma + 1);
+                    checkpointPath.erase(comma);
+                }
+                if(checkpointPath.empty() || checkpointInterval < 0){
+                    std::cerr << "Error: checkpoints must be checkpointFile[,intervalMs]" << std::endl;
+                    return 1;
+                }
+                break;
+            }
+            case 'k':
+                resumePath = optarg;
+                break;
+            case 'S':
+                runSeed = strtoull(optarg, nullptr, 10);
+                seedSet = true;
+                break;
+            case 'j':
+                workerCount = atoi(optarg);
+                if(workerCount < 1 || workerCount > TOTAL_INSTANCES){
+                    std::cerr << "Error: worker threads must be between 1 and " << TOTAL_INSTANCES << std::endl;
+                    return 1;
+                }
+                break;
         }
         }
 
+    // The shared image is checked once -g has sized the address space
+    if(!SetSharedPages(sharedImagePages)){
+        std::cerr << "Error: the shared image must be between 0 and " << pagesPerProcess << " pages" << std::endl;
+        return 1;
+    }
+
+    // A resumed run is configured by its checkpoint, whatever the command line says
+    bool resuming = !resumePath.empty();
+    if(resuming){
+        if(!CheckpointOpen(&resume, resumePath.c_str()) || !ApplyCheckpointConfig(&resume, &policyName)){
+            std::cerr << "Error: " << resumePath << " is not a checkpoint oss can resume from" << std::endl;
+            return 1;
+        }
+        watermarksSet = true;
+        seedSet = true;
+    }
+    if((resuming || !checkpointPath.empty()) && workerCount > 1){
+        std::cerr << "Error: checkpoints are taken between events of the single-threaded loop; -c and -k need -j 1" << std::endl;
+        return 1;
+    }
+
+    if(!seedSet){
+        runSeed = std::chrono::system_clock::now().time_since_epoch().count();
+    }
+
+    // The watermarks are in frames, so they are defaulted and checked once -g has sized the table
+    if(!watermarksSet){
+        freeLowWatermark = DEFAULT_LOW_WATERMARK;
+        freeHighWatermark = DEFAULT_HIGH_WATERMARK;
+    }
+    if(freeLowWatermark < 0 || freeHighWatermark > frameTableSize){
+        std::cerr << "Error: watermarks must be between 0 and " << frameTableSize << std::endl;
+        return 1;
+    }
+
+    if(inProcessMode && workerCount > 1){
+        std::cerr << "Error: in-process users are stepped on the main thread; -j needs -E process" << std::endl;
+        return 1;
+    }
+
+    // One frame table shard per worker, so workers mostly fault in different shards; prepaging is
+    // checked against them once they are sized
+    frameShardCount = (workerCount < MaxFrameShardCount()) ? workerCount : MaxFrameShardCount();
+    if(!PrefetchFitsShards()){
+        std::cerr << "Error: prepaging must cover fewer pages than a frame table shard has frames" << std::endl;
+        return 1;
+    }
+
     // Initialize signal handlers and start system clock
     std::signal(SIGALRM, HandleTimeout);
     std::signal(SIGINT, HandleInterrupt);
     alarm(5);
 
+    // Child exits arrive through a signalfd and requests through an eventfd doorbell
+    sigset_t sigchldMask;
+    sigemptyset(&sigchldMask);
+    sigaddset(&sigchldMask, SIGCHLD);
+    sigprocmask(SIG_BLOCK, &sigchldMask, NULL);
+    sigchldFd = signalfd(-1, &sigchldMask, SFD_NONBLOCK | SFD_CLOEXEC);
+    wakeFd = eventfd(0, EFD_NONBLOCK); // Inherited by children across execl
+    epollFd = epoll_create1(EPOLL_CLOEXEC);
+    if(sigchldFd == -1 || wakeFd == -1 || epollFd == -1){
+        perror("Error: failed to set up event descriptors");
+        return 1;
+    }
+    struct epoll_event ev;
+    ev.events = EPOLLIN;
+    ev.data.fd = sigchldFd;
+    epoll_ctl(epollFd, EPOLL_CTL_ADD, sigchldFd, &ev);
+    ev.data.fd = wakeFd;
+    epoll_ctl(epollFd, EPOLL_CTL_ADD, wakeFd, &ev);
+
+    key_t doorbell_key = ftok("/tmp", DOORBELL_PROJ_ID);
+    if((shmdid = shmget(doorbell_key, sizeof(Doorbell), IPC_CREAT | 0666)) == -1){
+        perror("shmget for doorbell in parent");
+        return 1;
+    }
+    doorbell = (Doorbell*)shmat(shmdid, NULL, 0);
+    doorbell->ossWaiting.store(0);
+    doorbell->wakeups.store(0);
+
+    frameShardLocking = workerCount > 1;
+    SetReplacementPolicy(policyName.c_str());
+    AllocateProcessTable(maxSimultaneousProcesses);
+    AllocateTlbs(maxSimultaneousProcesses);
+    tlbLocking = frameShardLocking;
     InitializeProcessTable(processTable);
-    InitializePageTable(frameTable);
-    shm_clock = (SystemClock*)shmat(shmtid, NULL, 0);
-    shm_clock->seconds = 0;
-    shm_clock->nanoseconds = 0;
+    diskRequests.resize(maxSimultaneousProcesses);
+    InitializeMetrics(maxSimultaneousProcesses);
+    userReadyAt.assign(maxSimultaneousProcesses, 0);
+    awaitingRequest.assign(maxSimultaneousProcesses, 0);
+    arrivedRequests.resize(maxSimultaneousProcesses);
+    userProgress.resize(maxSimultaneousProcesses);
+    if(workingSetWindow > 0){
+        InitializeAdmissionControl(maxSimultaneousProcesses);
+    }
+    if(inProcessMode){
+        inProcessUsers.resize(maxSimultaneousProcesses);
+    }
+    if((shmmid = CreateSharedSegment(memory_key, MemorySegmentSize(maxSimultaneousProcesses))) == -1){
+        perror("shmget for the frame and page tables in parent");
+        return 1;
+    }
+    memorySegment = shmat(shmmid, NULL, 0);
+    LayoutMemorySegment(memorySegment);
+    InitializePageTable(processTable);
+    if((shmtid = CreateSharedSegment(control_key, ControlSegmentSize(maxSimultaneousProcesses))) == -1){
+        perror("shmget for the control segment in parent");
+        return 1;
+    }
+    control = (ControlSegment*)shmat(shmtid, NULL, 0);
+    InitializeControlSegment(control, maxSimultaneousProcesses);
 
-    outputFile.open(logFileName);
-    if (!outputFile.is_open()) {
+    if (!LogInit(logFileName.c_str(), logLevel, logCategories, true)) {
         std::cerr << "Error: Unable to open logFileName" << std::endl;
         return 1;
     }
@@ -422,55 +2037,106 @@ int main(int argc, char** argv){
                 perror("msgget in parent");
                 exit(1);
         }
-        cout << "OSS: Message queue set up\n";
-    outputFile << "OSS: Message queue set up\n";
-    // Main loop for child process management and system monitoring
-    while(numberOfChildren > 0 || !IsProcessTableEmpty(processTable, maxSimultaneousProcesses)){
-        if(numberOfChildren > 0 && IsLaunchIntervalMet(launchInterval) && FindEmptyProcessSlot(processTable, maxSimultaneousProcesses)){
-            std::cout << "OSS: Launching Child Process..." << endl;
-            outputFile << "OSS: Launching Child Process..." << endl;
-            numberOfChildren--;
-            LaunchProcess(processTable, maxSimultaneousProcesses);
-        }
-
-        pid_t pid = waitpid((pid_t)-1, nullptr, WNOHANG); // Non-blocking wait for child termination
-        if (pid > 0){
-            std::cout << "OSS: Receiving child " << pid << " has terminated! Releasing childs' resources..." << std::endl;
+    LogPrintf(LOG_INFO, LOG_CAT_GENERAL, "OSS: Message queue set up\n");
 
-            int i = GetProcessIndex(processTable, maxSimultaneousProcesses, pid);
-
-            if(processTable[i].isOccupied){
-                RemoveProcessFromTable(processTable, pid, maxSimultaneousProcesses);
-            }
-            pid = 0;
+    if(!traceFileName.empty()){
+        if(!TraceOpenWriter(&referenceTrace, traceFileName.c_str(), pageSize, pagesPerProcess, sharedPages)){
+            perror("Error: unable to create trace file");
+            exit(1);
         }
+        recordingTrace = true;
+        LogPrintf(LOG_INFO, LOG_CAT_GENERAL, "OSS: Recording references to %s\n", traceFileName.c_str());
+    }
 
-        MessageBuffer rcvbuf;
-        if (msgrcv(msgqid, &rcvbuf, sizeof(MessageBuffer), getpid(), IPC_NOWAIT) == -1) {
-            if (errno != ENOMSG){
-                perror("Error: failed to receive message in parent\n");
-                CleanupSystem("perror encountered.");
-                exit(1);
+    // Initialize the per-slot ring buffers
+    if(transport == TRANSPORT_RING){
+        key_t ring_key = ftok("/tmp", RING_PROJ_ID);
+        if((shmrid = CreateSharedSegment(ring_key, sizeof(ChannelPair) * maxSimultaneousProcesses)) == -1){
+            perror("shmget for rings in parent");
+            exit(1);
+        }
+        channels = (ChannelPair*)shmat(shmrid, NULL, 0);
+        ringClaimed = new std::atomic<bool>[maxSimultaneousProcesses]();
+        LogPrintf(LOG_INFO, LOG_CAT_GENERAL, "OSS: Ring buffers set up\n");
+    }
+    // Event loop: run events in simulated time order, jumping the clock from one to the next
+    if(resuming){
+        if(!RestoreSimulation(&resume)){
+            std::cerr << "Error: checkpoint " << resumePath << " is damaged" << std::endl;
+            RemoveSharedResources();
+            shmdt(control);
+            shmctl(shmtid, IPC_RMID, NULL);
+            return 1;
+        }
+        CheckpointClose(&resume);
+        long long now = SimulatedTime();
+        LogPrintf(LOG_INFO, LOG_CAT_GENERAL, "OSS: Resumed from %s at time %d:%d\n", resumePath.c_str(), TimeSeconds(now), TimeNanoseconds(now));
+    } else {
+        ScheduleEvent(EVENT_LAUNCH, launchInterval);
+        ScheduleEvent(EVENT_TABLE_DUMP, TABLE_DUMP_INTERVAL);
+        if(workingSetWindow > 0){
+            ScheduleEvent(EVENT_ADMISSION, ADMISSION_INTERVAL);
+        }
+    }
+    if(!checkpointPath.empty() && checkpointInterval > 0){
+        ScheduleEvent(EVENT_CHECKPOINT, SimulatedTime() + checkpointInterval);
+    }
+    MessageBuffer rcvbuf;
+    if(inProcessMode){
+        // Users run as state machines on this thread, each turn an event, so nothing ever waits on a descriptor
+        while(!term && (numberOfChildren > 0 || !IsProcessTableEmpty()) && RunNextEvent(nullptr)){
+        }
+    }
+    if(workerCount > 1){
+        // Workers serve the requests; this thread runs timers, reaps children and drives the device
+        mainWakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        StartWorkers();
+        while(!term && (numberOfChildren > 0 || !IsProcessTableEmpty())){
+            RunDueEvents();
+            ReapChildren();
+            StartNextPageIn();
+            WakeReclaimer();
+            if(AreAllProcessesBlocked()){
+                if(!PageInWaiting()){
+                    AdvanceClockTo(NextEventDue());
+                }
+                continue;
+            }
+            mainNextEventDue.store(NextEventDue());
+            struct pollfd events[2] = {{sigchldFd, POLLIN, 0}, {mainWakeFd, POLLIN, 0}};
+            if(poll(events, 2, WORKER_IDLE_TIMEOUT_MS) > 0 && events[1].revents){
+                uint64_t count;
+                read(mainWakeFd, &count, sizeof(count));
+                mainWakePending.store(false);
             }
         }
-        if(rcvbuf.msgCode == -1){
-            std::cout << "OSS: Checked and found no messages for OSS in the msgqueue." << std::endl;
-        } else if(rcvbuf.msgCode == MSG_READ || rcvbuf.msgCode == MSG_WRITE){
-            std::cout << "OSS: " << rcvbuf.sender << " requesting read/write of address " << rcvbuf.memoryAddress << " at time " << shm_clock->seconds << ":" << shm_clock->nanoseconds << std::endl;
-            HandlePageRequest(frameTable, &outputFile, shm_clock, rcvbuf.sender, rcvbuf.memoryAddress, rcvbuf.msgCode);
+        StopWorkers();
+    }
+    while(!term && (numberOfChildren > 0 || !IsProcessTableEmpty())){
+        // An event may only run once no user can still send a request due before it
+        Event horizon;
+        bool limited = ArrivalHorizon(&horizon);
+        if(RunNextEvent(limited ? &horizon : nullptr)){
+            continue;
         }
 
-        IncrementClock(shm_clock, DISPATCH_AMOUNT);
-        DisplayProcessTable(processTable, maxSimultaneousProcesses, shm_clock->seconds, shm_clock->nanoseconds, outputFile);
-        DisplayPageTable(frameTable, shm_clock->seconds, shm_clock->nanoseconds, outputFile);
-        std::cout << "Looping!" << std::endl;
+        // Take in the requests and exits that have arrived, and sleep if there are none yet
+        int arrived = 0;
+        while(ReceiveRequest(&rcvbuf, 0)){
+            ScheduleArrival(&rcvbuf);
+            arrived++;
+        }
+        arrived += ReapChildren();
+        if(arrived == 0 && WaitForEvents(&rcvbuf)){
+            ScheduleArrival(&rcvbuf);
+        }
     }
 
-        std::cout << "OSS: Child processes have completed. (" << numberOfChildren << " remaining)\n";
-    std::cout << "OSS: Parent is now ending.\n";
-    outputFile << "OSS: Child processes have completed. (" << numberOfChildren << " remaining)\n";
-    outputFile << "OSS: Parent is now ending.\n";
-    outputFile.close();
+    if(term){
+        CleanupSystem((term == SIGALRM) ? "Timeout Occurred." : "Ctrl+C detected.");
+    }
+    LogPrintf(LOG_INFO, LOG_CAT_GENERAL, "OSS: Child processes have completed. (%d remaining)\n", numberOfChildren);
+    LogPrintf(LOG_INFO, LOG_CAT_GENERAL, "OSS: Parent is now ending.\n");
 
     CleanupSystem("Shutting down OSS.");
 
@@ -478,100 +2144,341 @@ int main(int argc, char** argv){
 }
 
 // Implementations of helper functions for process and system management
-void SendMessageToProcess(MessageBuffer buf){
-    if (msgsnd(msgqid, &buf, sizeof(MessageBuffer), 0) == -1) {
+void SendMessageToProcess(int slot, MessageBuffer buf){
+    StopRequestTimer(slot);
+    NoteUserReply(slot, &buf);
+    AwaitUser(slot, SimulatedTime() + USER_THINK_TIME);
+    if(inProcessMode){
+        inProcessUsers[slot].reply = buf;
+        return;
+    }
+    if(transport == TRANSPORT_RING){
+        ipcSyscalls += RingPush(&channels[slot].reply, &buf, MESSAGE_SIZE(0));
+        return;
+    }
+    ipcSyscalls++;
+    if (msgsnd(msgqid, &buf, MESSAGE_SIZE(0), 0) == -1) {
         perror("msgsnd to child failed\n");
         exit(1);
     }
 }
 
-// Launches a child process and updates the process table
-void LaunchProcess(ProcessControlBlock processTable[], int maxSimultaneousProcesses){
+// Polls the selected transport for a request without blocking; returns false if none is waiting
+bool ReceiveRequest(MessageBuffer* rcvbuf, int worker){
+    if(transport == TRANSPORT_RING){
+        // Round-robin over the slots so that no child's ring is starved; with several workers a ring
+        // is claimed while it is popped, so each still has a single consumer at a time
+        for(int n = 0; n < maxSimultaneousProcesses; n++){
+            int i = (nextRingToPoll[worker] + n) % maxSimultaneousProcesses;
+            if(!processTable[i].isOccupied || (workerCount > 1 && ringClaimed[i].exchange(true))){
+                continue;
+            }
+            int syscalls = 0;
+            bool popped = RingTryPop(&channels[i].request, rcvbuf, &syscalls);
+            if(workerCount > 1){
+                ringClaimed[i].store(false);
+            }
+            if(popped){
+                ipcSyscalls += syscalls;
+                nextRingToPoll[worker] = (i + 1) % maxSimultaneousProcesses;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    ipcSyscalls++;
+    if (msgrcv(msgqid, rcvbuf, MESSAGE_SIZE(MAX_BATCH_SIZE), getpid(), IPC_NOWAIT) == -1) {
+        if (errno != ENOMSG){
+            perror("Error: failed to receive message in parent\n");
+            CleanupSystem("perror encountered.");
+            exit(1);
+        }
+        return false;
+    }
+    return true;
+}
+
+// Records a newly started process in a slot of the process table and charges the launch
+void FillProcessSlot(int i, pid_t pid){
+    InsertProcessIntoTable(processTable, i, pid);
+    processTable[i].startTime = SimulatedTime();
+    processTable[i].blocked = 0;
+    processTable[i].blockedUntil = 0;
+    processTable[i].suspended = 0;
+    for(int j = 0; j < TOTAL_RESOURCES; j++){
+        processTable[i].resourcesHeld[j] = 0;
+    }
+    ResetWorkingSet(i);
+    ResetProcessMetrics(i, pid, launchCount - 1);
+    ResetUserProgress(i);
+    ControlSlotStats(control, i)->pid.store(pid, std::memory_order_relaxed);
+    IncrementClock(CHILD_LAUNCH_AMOUNT);
+    AwaitUser(i, SimulatedTime());
+}
+
+// Launches a child process, or an in-process user, and updates the process table
+void LaunchProcess(){
+    std::unique_lock<std::shared_mutex> tableGuard(processTableLock);
+    int i = (FindEmptyProcessSlot() - 1);
+    uint64_t seed = WorkloadSeed(runSeed, i, launchCount++);
+    ResetSlotStats(ControlSlotStats(control, i), 0);
+    if(inProcessMode){
+        pid_t userPid = nextInProcessPid++;
+        InitializeUser(&inProcessUsers[i].state, &inProcessUsers[i].request, userPid, getpid(), pageSize, pagesPerProcess,
+                       &workload, readPercent, seed);
+        inProcessUsers[i].reply.count = 0;
+        FillProcessSlot(i, userPid);
+        return;
+    }
+    FillProcessSlot(i, ForkUser(i, seed, false));
+}
+
+// Forks and execs ./user into a slot and returns its pid; a resumed user takes over from the one the
+// slot held at a checkpoint, through the slot's SlotResume
+pid_t ForkUser(int i, uint64_t seed, bool resume){
+    if(transport == TRANSPORT_RING){
+        ResetRing(&channels[i].request);
+        ResetRing(&channels[i].reply);
+        channels[i].childSyscalls.store(0);
+    }
+
+    // Built before fork: with worker threads running the child may only make async-signal-safe calls
+    std::string batch = std::to_string(batchSize);
+    std::string transportName = (transport == TRANSPORT_RING) ? "ring" : "msgq";
+    std::string slot = std::to_string(i);
+    std::string wake = std::to_string(wakeFd);
+    std::string size = std::to_string(pageSize);
+    std::string pages = std::to_string(pagesPerProcess);
+    std::string reads = std::to_string(readPercent);
+    std::string userSeed = std::to_string(seed);
+    const char* verbosity = LogEnabled(LOG_INFO, LOG_CAT_GENERAL) ? "v" : "q";
     pid_t childPid = fork();
     if (childPid == 0) {
-        execl("./user", "./user", nullptr);
+        sigset_t sigchldMask;
+        sigemptyset(&sigchldMask);
+        sigaddset(&sigchldMask, SIGCHLD);
+        sigprocmask(SIG_UNBLOCK, &sigchldMask, NULL);
+        execl("./user", "./user", batch.c_str(), transportName.c_str(), slot.c_str(), wake.c_str(), verbosity, size.c_str(), pages.c_str(),
+              workloadName.c_str(), reads.c_str(), userSeed.c_str(), resume ? "resume" : "new", nullptr);
         perror("LaunchProcess(): execl() has failed!");
         exit(EXIT_FAILURE);
     } else if (childPid == -1) {
         perror("Error: Fork has failed");
         exit(EXIT_FAILURE);
-    } else {
-        int i = (FindEmptyProcessSlot(processTable, maxSimultaneousProcesses) - 1);
-        processTable[i].isOccupied = 1;
-        processTable[i].pid = childPid;
-        processTable[i].startSecs = shm_clock->seconds;
-        processTable[i].startNanos = shm_clock->nanoseconds;
-        processTable[i].blocked = 0;
-        for(int j = 0; j < TOTAL_RESOURCES; j++){
-            processTable[i].resourcesHeld[j] = 0;
-        }
-        IncrementClock(shm_clock, CHILD_LAUNCH_AMOUNT);
     }
+    return childPid;
 }
 
 
-// Checks if the launch interval is met to start a new process
-bool IsLaunchIntervalMet(int launchInterval){
-    static int last_launch_secs = 0;
-    static int last_launch_nanos = 0;
+// Signal handler for system timeout; the event loop shuts down once the event in hand is done
+void HandleTimeout(int signum) {
+    term = signum;
+}
 
-    int elapsed_secs = shm_clock->seconds - last_launch_secs;
-    int elapsed_nanos = shm_clock->nanoseconds - last_launch_nanos;
+// Signal handler for Ctrl+C interruption
+void HandleInterrupt(int signum) {
+    term = signum;
+}
 
-    while (elapsed_nanos < 0) {
-        elapsed_secs--;
-        elapsed_nanos += 1000000000;
-    }
+// Writes one latency histogram's summary as a JSON object
+void WriteLatencyJson(FILE* file, const char* name, const LatencyHistogram* histogram, bool last){
+    fprintf(file, "    \"%s\": {\"count\": %llu, \"mean\": %.1f, \"p50\": %llu, \"p90\": %llu, \"p99\": %llu, \"p999\": %llu, \"max\": %llu}%s\n",
+            name, (unsigned long long)histogram->count.load(), HistogramMean(histogram),
+            (unsigned long long)HistogramPercentile(histogram, 50), (unsigned long long)HistogramPercentile(histogram, 90),
+            (unsigned long long)HistogramPercentile(histogram, 99), (unsigned long long)HistogramPercentile(histogram, 99.9),
+            (unsigned long long)histogram->max.load(), last ? "" : ",");
+}
 
-    if (elapsed_secs > 0 || (elapsed_secs == 0 && elapsed_nanos >= launchInterval)) {
-        last_launch_secs = shm_clock->seconds;
-        last_launch_nanos = shm_clock->nanoseconds;
-        return true;
-    } else {
-        return false;
+// Writes the report as prefix.json (configuration, totals, latency percentiles and every process) and
+// prefix.csv (one row per process), so runs can be compared by scripts. Processes still running at
+// shutdown are included with an end time of -1
+void WriteReport(double duration, long long simulatedTime){
+    std::vector<ProcessMetrics> processes = finishedMetrics;
+    for(int i = occupiedSlotHead; i != -1; i = processTable[i].nextSlot){
+        processes.push_back(SnapshotProcessMetrics(i));
     }
-}
+    long long hits = memoryAccesses - pageFaults;
 
-// Signal handler for system timeout
-void HandleTimeout(int signum) {
-    CleanupSystem("Timeout Occurred.");
+    string jsonName = reportPrefix + ".json";
+    FILE* json = fopen(jsonName.c_str(), "w");
+    if(json == nullptr){
+        perror("Error: unable to write the JSON report");
+        return;
+    }
+    fprintf(json, "{\n  \"config\": {\"policy\": \"%s\", \"workers\": %d, \"frames\": %d, \"pageSize\": %d, \"pagesPerProcess\": %d, "
+            "\"slots\": %d, \"workload\": \"%s\", \"readPercent\": %d, \"seed\": %llu, \"batchSize\": %d, \"diskLatencyNs\": %lld, "
+            "\"tlbEntries\": %d, \"prefetch\": \"%s\", \"workingSetWindow\": %d, \"sharedPages\": %d},\n",
+            frameShards[0].policy->Name(), workerCount, frameTableSize, pageSize, pagesPerProcess, maxSimultaneousProcesses,
+            workloadName.c_str(), readPercent, (unsigned long long)runSeed, batchSize, diskLatency, tlbEntries,
+            PrefetchModeName(), workingSetWindow, sharedPages);
+    fprintf(json, "  \"totals\": {\"processes\": %zu, \"memoryAccesses\": %lld, \"hits\": %lld, \"faults\": %lld, \"faultsPerAccess\": %.6f, "
+            "\"dirtyWriteBacks\": %lld, \"backgroundWriteBacks\": %d, \"bytesWrittenBack\": %lld, \"blockedTimeNs\": %lld, "
+            "\"poolFaults\": %d, \"synchronousEvictions\": %d, \"tlbHits\": %lld, \"tlbMisses\": %lld, \"prefetchedPages\": %d, "
+            "\"sharedPageMappings\": %d, \"copyOnWriteFaults\": %d, \"copyOnWriteCopies\": %d, \"peakResidentFrames\": %d, "
+            "\"ipcSyscalls\": %lld, \"events\": %lld, \"wallSeconds\": %.6f, \"simulatedNs\": %lld},\n",
+            processes.size(), memoryAccesses.load(), hits, pageFaults.load(),
+            memoryAccesses ? (double)pageFaults / memoryAccesses : 0.0, pageWriteBacks.load(), backgroundWriteBacks.load(),
+            (long long)pageWriteBacks * pageSize, blockedTime, poolFaults.load(), synchronousEvictions.load(), tlbHits.load(),
+            tlbMisses.load(), prefetchedPages.load(), sharedPageMappings.load(), copyOnWriteFaults.load(), copyOnWriteCopies.load(),
+            peakResidentFrames.load(), ipcSyscalls + childIpcSyscalls, eventsFired, duration, simulatedTime);
+    fprintf(json, "  \"requestLatency\": {\n");
+    WriteLatencyJson(json, "simulatedNs", &simulatedLatency, false);
+    WriteLatencyJson(json, "wallNs", &wallLatency, true);
+    fprintf(json, "  },\n  \"processes\": [\n");
+    for(size_t p = 0; p < processes.size(); p++){
+        const ProcessMetrics* metrics = &processes[p];
+        fprintf(json, "    {\"pid\": %d, \"slot\": %d, \"launch\": %d, \"startedAtNs\": %lld, \"endedAtNs\": %lld, \"requests\": %lld, "
+                "\"hits\": %lld, \"faults\": %lld, \"dirtyWriteBacks\": %lld, \"bytesWrittenBack\": %lld, \"blockedTimeNs\": %lld, "
+                "\"referencesGenerated\": %lld, \"writesGenerated\": %lld, \"blockedReplies\": %lld, \"replyWaitWallNs\": %lld}%s\n",
+                (int)metrics->pid, metrics->slot, metrics->launch, metrics->startedAt, metrics->endedAt, metrics->requests,
+                metrics->hits, metrics->faults, metrics->writeBacks, metrics->writeBacks * pageSize, metrics->blockedTime,
+                metrics->referencesGenerated, metrics->writesGenerated, metrics->blockedReplies, metrics->replyWaitTime,
+                (p + 1 < processes.size()) ? "," : "");
+    }
+    fprintf(json, "  ]\n}\n");
+    fclose(json);
+
+    string csvName = reportPrefix + ".csv";
+    FILE* csv = fopen(csvName.c_str(), "w");
+    if(csv == nullptr){
+        perror("Error: unable to write the CSV report");
+        return;
+    }
+    fprintf(csv, "pid,slot,launch,startedAtNs,endedAtNs,requests,hits,faults,dirtyWriteBacks,bytesWrittenBack,blockedTimeNs,"
+            "referencesGenerated,writesGenerated,blockedReplies,replyWaitWallNs\n");
+    for(const ProcessMetrics& metrics : processes){
+        fprintf(csv, "%d,%d,%d,%lld,%lld,%lld,%lld,%lld,%lld,%lld,%lld,%lld,%lld,%lld,%lld\n", (int)metrics.pid, metrics.slot, metrics.launch,
+                metrics.startedAt, metrics.endedAt, metrics.requests, metrics.hits, metrics.faults, metrics.writeBacks,
+                metrics.writeBacks * pageSize, metrics.blockedTime, metrics.referencesGenerated, metrics.writesGenerated,
+                metrics.blockedReplies, metrics.replyWaitTime);
+    }
+    fclose(csv);
+    LogPrintf(LOG_INFO, LOG_CAT_REPORT, "Report written to %s and %s\n", jsonName.c_str(), csvName.c_str());
 }
 
-// Signal handler for Ctrl+C interruption
-void HandleInterrupt(int signum) {
-    CleanupSystem("Ctrl+C detected.");
+// Returns the counters every user kept about itself, with the requests oss handled for them, summed
+// over finished and running processes
+ProcessMetrics SumUserCounters(){
+    ProcessMetrics sum = ProcessMetrics();
+    std::vector<ProcessMetrics> running;
+    for(int i = occupiedSlotHead; i != -1; i = processTable[i].nextSlot){
+        running.push_back(SnapshotProcessMetrics(i));
+    }
+    for(const std::vector<ProcessMetrics>* list : {&finishedMetrics, &running}){
+        for(const ProcessMetrics& metrics : *list){
+            sum.requests += metrics.requests;
+            sum.referencesGenerated += metrics.referencesGenerated;
+            sum.writesGenerated += metrics.writesGenerated;
+            sum.blockedReplies += metrics.blockedReplies;
+            sum.replyWaitTime += metrics.replyWaitTime;
+        }
+    }
+    return sum;
 }
 
 // Outputs statistics and finalizes system shutdown
-void OutputStats(double duration){
-    std::cout << "\nFinal Report" << std::endl;
-    std::cout << "Number of Faults: " << pageFaults << std::endl;
-    std::cout << "Number of Memory Accesses: " << memoryAccesses << std::endl;
-    std::cout << "Number of Memory Accesses per second: " << std::fixed << std::setprecision(1) << static_cast<double>(memoryAccesses)/duration << std::endl;
-    std::cout << "Average Number of Faults per Memory Access: " << std::fixed << std::setprecision(1) << static_cast<double>(pageFaults)/memoryAccesses << std::endl;
-
-    outputFile << "\nRUN RESULT REPORT" << std::endl;
-    outputFile << "Number of PageTableEntry Faults: " << pageFaults << std::endl;
-    outputFile << "Number of Memory Accesses: " << memoryAccesses << std::endl;
-    outputFile << "Number of Memory Accesses per second: " << std::fixed << std::setprecision(1) << static_cast<double>(memoryAccesses)/duration << std::endl;
-    outputFile << "Average Number of PageTableEntry Faults per Memory Access: " << std::fixed << std::setprecision(1) << static_cast<double>(pageFaults)/memoryAccesses << std::endl;
+void OutputStats(double duration, long long simulatedTime){
+    LogPrintf(LOG_INFO, LOG_CAT_REPORT, "\nFinal Report\n");
+    LogPrintf(LOG_INFO, LOG_CAT_REPORT, "Replacement Policy: %s\n", frameShards[0].policy->Name());
+    LogPrintf(LOG_INFO, LOG_CAT_REPORT, "Worker Threads: %d (%d frame table shards)\n", workerCount, frameShardCount);
+    LogPrintf(LOG_INFO, LOG_CAT_REPORT, "Workload: %s, %d%% reads, seed %llu\n", workloadName.c_str(), readPercent, (unsigned long long)runSeed);
+    LogPrintf(LOG_INFO, LOG_CAT_REPORT, "Number of Faults: %lld\n", pageFaults.load());
+    LogPrintf(LOG_INFO, LOG_CAT_REPORT, "Number of Dirty Page Write-backs: %lld (%d in the background, %lld bytes)\n", pageWriteBacks.load(), backgroundWriteBacks.load(), (long long)pageWriteBacks * pageSize);
+    LogPrintf(LOG_INFO, LOG_CAT_REPORT, "Faults Served from the Free Pool: %d\n", poolFaults.load());
+    LogPrintf(LOG_INFO, LOG_CAT_REPORT, "Synchronous Evictions: %d\n", synchronousEvictions.load());
+    if(workingSetWindow > 0){
+        LogPrintf(LOG_INFO, LOG_CAT_REPORT, "Admission Control: %d-reference working-set window%s; %d launches delayed, %d suspensions (%d pages swapped out), peak demand %d of %d frames\n",
+                  workingSetWindow, admissionSuspends ? " with suspension" : "", launchesDelayed, suspensions, swappedOutPages, peakMemoryDemand, frameTableSize);
+    }
+    if(sharedPages > 0){
+        LogPrintf(LOG_INFO, LOG_CAT_REPORT, "Shared Image: %d pages; %d references mapped a resident page without a page-in, %d copy-on-write faults (%d copied)\n",
+                  sharedPages, sharedPageMappings.load(), copyOnWriteFaults.load(), copyOnWriteCopies.load());
+    }
+    LogPrintf(LOG_INFO, LOG_CAT_REPORT, "Peak Resident Frames: %d of %d\n", peakResidentFrames.load(), frameTableSize);
+    if(prefetchMode != PREFETCH_OFF){
+        LogPrintf(LOG_INFO, LOG_CAT_REPORT, "Prepaging: %s, up to %d pages; %d prefetched, %d hits, %d wasted\n", PrefetchModeName(), prefetchPages,
+                  prefetchedPages.load(), prefetchHits.load(), prefetchWaste.load());
+    }
+    LogPrintf(LOG_INFO, LOG_CAT_REPORT, "Number of Memory Accesses: %lld\n", memoryAccesses.load());
+    LogPrintf(LOG_INFO, LOG_CAT_REPORT, "Number of Memory Accesses per second: %.1f\n", static_cast<double>(memoryAccesses)/duration);
+    LogPrintf(LOG_INFO, LOG_CAT_REPORT, "Average Number of Faults per Memory Access: %.4f\n", memoryAccesses ? static_cast<double>(pageFaults)/memoryAccesses : 0.0);
+    LogPrintf(LOG_INFO, LOG_CAT_REPORT, "IPC Syscalls per Memory Access: %.3f (batch size %d)\n", static_cast<double>(ipcSyscalls + childIpcSyscalls)/memoryAccesses, batchSize);
+    if(diskLatency > 0){
+        LogPrintf(LOG_INFO, LOG_CAT_REPORT, "Paging Device: %lld ms per I/O, %s queue, %lld page-ins\n", diskLatency / 1000000, (diskScheduler == DISK_ELEVATOR) ? "elevator" : "fifo", diskReads);
+        LogPrintf(LOG_INFO, LOG_CAT_REPORT, "Average Page Fault Service Time: %.3f ms\n", diskReads ? faultServiceTime / 1e6 / diskReads : 0.0);
+        LogPrintf(LOG_INFO, LOG_CAT_REPORT, "Total Time Processes Spent Blocked: %.3f s\n", blockedTime / 1e9);
+    }
+    // Hits cost MEMORY_ACCESS_TIME, plus the TLB lookup and on a TLB miss a page table walk; a fault costs
+    // the time from taking it to the page being in
+    long long hits = memoryAccesses - pageFaults;
+    double hitTime = hits * (double)MEMORY_ACCESS_TIME;
+    if(tlbEntries > 0){
+        long long tlbLookups = tlbHits + tlbMisses;
+        hitTime = tlbHits * (double)ResidentAccessTime(true) + (hits - tlbHits) * (double)ResidentAccessTime(false);
+        LogPrintf(LOG_INFO, LOG_CAT_REPORT, "TLB: %d entries, %d-way, %s; hit rate %.4f (%lld of %lld lookups)\n", tlbEntries, tlbWays,
+                  TlbReplacementName(), tlbLookups ? (double)tlbHits / tlbLookups : 0.0, tlbHits.load(), tlbLookups);
+        LogPrintf(LOG_INFO, LOG_CAT_REPORT, "Effective Memory Access Time (resident pages): %.1f ns\n", hits ? hitTime / hits : 0.0);
+    }
+    double accessTime = (hitTime + faultServiceTime) / (memoryAccesses ? memoryAccesses.load() : 1);
+    LogPrintf(LOG_INFO, LOG_CAT_REPORT, "Effective Access Time: %.1f ns\n", accessTime);
+    LogPrintf(LOG_INFO, LOG_CAT_REPORT, "Simulated Run Time: %.3f s (%.1f memory accesses per simulated second)\n", simulatedTime / 1e9, simulatedTime ? memoryAccesses / (simulatedTime / 1e9) : 0.0);
+    LogPrintf(LOG_INFO, LOG_CAT_REPORT, "Simulation Events: %lld\n", eventsFired);
+    ProcessMetrics users = SumUserCounters();
+    LogPrintf(LOG_INFO, LOG_CAT_REPORT, "User-Side Counters: %lld references generated (%lld writes), %lld blocked replies, mean reply wait %.1f us\n",
+              users.referencesGenerated, users.writesGenerated, users.blockedReplies, users.requests ? users.replyWaitTime / 1e3 / users.requests : 0.0);
+    LogPrintf(LOG_INFO, LOG_CAT_REPORT, "Request Service Latency (simulated): mean %.1f us, p50 %.1f us, p99 %.1f us, max %.1f us over %llu requests\n",
+              HistogramMean(&simulatedLatency) / 1e3, HistogramPercentile(&simulatedLatency, 50) / 1e3, HistogramPercentile(&simulatedLatency, 99) / 1e3,
+              simulatedLatency.max / 1e3, (unsigned long long)simulatedLatency.count.load());
+    LogPrintf(LOG_INFO, LOG_CAT_REPORT, "Request Service Latency (wall clock): mean %.1f us, p50 %.1f us, p99 %.1f us, max %.1f us\n",
+              HistogramMean(&wallLatency) / 1e3, HistogramPercentile(&wallLatency, 50) / 1e3, HistogramPercentile(&wallLatency, 99) / 1e3,
+              wallLatency.max / 1e3);
+    if(!reportPrefix.empty()){
+        WriteReport(duration, simulatedTime);
+    }
 }
 
-// Cleans up system resources and prepares for shutdown
-void CleanupSystem(std::string cause) {
-    std::cout << cause << " Cleaning up" << std::endl;
-    outputFile << cause << " Cleaning up" << std::endl;
-    TerminateAllProcesses(processTable, maxSimultaneousProcesses);
-    outputFile.close();
-    shmdt(shm_clock);
+// Detaches and removes the frame table, rings, doorbell and message queue; the control segment is left
+// for the report
+void RemoveSharedResources(){
+    shmdt(memorySegment);
+    shmctl(shmmid, IPC_RMID, NULL);
+    if(channels != nullptr){
+        shmdt(channels);
+        shmctl(shmrid, IPC_RMID, NULL);
+    }
+    shmdt(doorbell);
+    shmctl(shmdid, IPC_RMID, NULL);
     if (msgctl(msgqid, IPC_RMID, NULL) == -1) {
                 perror("Error: msgctl to get rid of queue in parent failed");
                 exit(1);
         }
+}
+
+// Cleans up system resources and prepares for shutdown
+void CleanupSystem(std::string cause) {
+    LogPrintf(LOG_INFO, LOG_CAT_GENERAL, "%s Cleaning up\n", cause.c_str());
+    StopWorkers();
+    if(term && !checkpointPath.empty()){
+        WriteCheckpoint(); // Stopped between events, so the run can be resumed from here
+    }
+    if(!inProcessMode){
+        TerminateAllProcesses(processTable); // Simulated pids name no real process
+    }
+    if(recordingTrace){
+        TraceCloseWriter(&referenceTrace);
+        recordingTrace = false;
+    }
+    long long simulatedTime = SimulatedTime();
+    childIpcSyscalls += doorbell->wakeups.load();
+    RemoveSharedResources();
 
     std::chrono::high_resolution_clock::time_point end = std::chrono::high_resolution_clock::now();
     std::chrono::duration<double> duration = end - start;
-    OutputStats(static_cast<double>(duration.count()));
+    OutputStats(static_cast<double>(duration.count()), simulatedTime);
+    shmdt(control); // Kept until the report has read the users' counters
+    shmctl(shmtid, IPC_RMID, NULL);
+    LogShutdown();
 
     std::exit(EXIT_SUCCESS);
 }
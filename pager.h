@@ -0,0 +1,830 @@
+// Memory manager shared by oss and the trace replay engine: per-process page tables, the
+// inverted frame table split into shards, each shard's free-frame pool, the shared image every process
+// maps copy-on-write and the hooks a replacement policy (policy.h) plugs into
+#ifndef PAGER_H
+#define PAGER_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <atomic>
+#include <mutex>
+#include <vector>
+#include "transport.h"
+#include "logger.h"
+#include "tlb.h"
+
+#define TOTAL_RESOURCES 10
+#define TOTAL_INSTANCES 20 // Default number of process table slots
+#define DEFAULT_FRAME_TABLE_SIZE 256
+#define DEFAULT_PAGE_SIZE 1024
+#define DEFAULT_PAGES_PER_PROCESS 64
+#define MAX_ADDRESS_SPACE (1 << 30) // Addresses must fit the 30 address bits of a trace record
+#define MAX_FRAME_SHARDS 16
+#define FRAME_WORD_BITS 64 // Frames covered by one word of the reference and dirty bitsets
+#define PREFETCH_OFF 0
+#define PREFETCH_CLUSTER 1   // A fault brings in the rest of its aligned cluster of pages
+#define PREFETCH_READAHEAD 2 // A fault brings in a window of following pages that grows while faults stay sequential
+#define DEFAULT_PREFETCH_PAGES 8
+#define MAPPING_COPIED -2 // Reverse-map link of a process that has its own copy of a page of the shared image
+
+// Memory geometry, set with oss -g or replay -g before the tables are laid out
+inline int frameTableSize = DEFAULT_FRAME_TABLE_SIZE;
+inline int pageSize = DEFAULT_PAGE_SIZE;
+inline int pageShift = 10; // log2(pageSize)
+inline int pagesPerProcess = DEFAULT_PAGES_PER_PROCESS;
+inline int sharedPages = 0; // The first sharedPages pages of every address space map one shared image
+
+// Sets the page size and per-process page count; the page size must be a power of two and a
+// process's address space must fit in MAX_ADDRESS_SPACE. Returns false, changing nothing, if not
+inline bool SetPageGeometry(int size, int pages){
+    if(size < 1 || pages < 1 || (size & (size - 1)) != 0 || (long long)size * pages > MAX_ADDRESS_SPACE){
+        return false;
+    }
+    pageSize = size;
+    pagesPerProcess = pages;
+    pageShift = 0;
+    while((1 << pageShift) < pageSize){
+        pageShift++;
+    }
+    return true;
+}
+
+// Parses frames[,pageSize[,pagesPerProcess]]; returns false, changing nothing, if it is not valid
+inline bool ParseGeometry(const char* arg){
+    int frames = frameTableSize, size = pageSize, pages = pagesPerProcess;
+    if(sscanf(arg, "%d,%d,%d", &frames, &size, &pages) < 1 || frames < 1){
+        return false;
+    }
+    if(!SetPageGeometry(size, pages)){
+        return false;
+    }
+    frameTableSize = frames;
+    return true;
+}
+
+// Sets how many pages at the start of every address space belong to the shared image (oss -H); returns
+// false, changing nothing, if that is more than an address space holds
+inline bool SetSharedPages(int pages){
+    if(pages < 0 || pages > pagesPerProcess){
+        return false;
+    }
+    sharedPages = pages;
+    return true;
+}
+
+// Returns the virtual page an address falls in
+inline int PageNumber(int memoryAddress){
+    return memoryAddress >> pageShift;
+}
+
+// Structures for PCB
+struct ProcessControlBlock {
+    int isOccupied;
+    pid_t pid;
+    long long startTime;       // Simulated ns
+    int blocked;               // Waiting for a page-in on the paging device
+    long long blockedUntil;    // When that page-in completes, once it is in service
+    int resourcesHeld[TOTAL_RESOURCES];
+    int32_t* pageTable; // pagesPerProcess frame numbers in the shared memory segment, -1 when not resident,
+                        // then a reverse-map link for each page of the shared image (see MapperLink)
+    int nextSlot;     // links in the occupied list, or the free list (next only) while the slot is empty
+    int prevSlot;
+    int nextInBucket; // next slot in the same bucket of the pid index
+    int readAheadNext;   // Page whose fault would continue the current sequential run
+    int readAheadWindow; // Pages read ahead on the last fault
+    int suspended;       // Swapped out by oss's admission control until memory pressure drops
+};
+
+// Structures for the inverted frame table, laid out as separate arrays so a table of millions of
+// frames stays compact: the owner and page of each frame, how many page tables map it, and one bit per
+// frame for the reference and dirty bits, for whether the frame holds a page at all and for whether that
+// page was prefetched and has not been referenced yet. A frame holding a page of the shared image is
+// mapped by every process that has referenced the page since it came in; its owner is the first of them
+// and the rest follow through their reverse-map links. Such a frame is never dirty: a write gives the
+// writer a copy of its own
+struct FrameTable {
+    uint64_t* residentBits;
+    uint64_t* referenceBits;
+    uint64_t* dirtyBits;
+    uint64_t* prefetchBits;
+    int32_t* ownerSlot;  // process table slot owning the frame, -1 when free
+    int32_t* pageNumber;
+    int32_t* mapCount;   // Page tables mapping the frame, 0 when free
+};
+
+inline FrameTable frameTable;
+
+inline bool TestFrameBit(const uint64_t* bits, int frame){
+    return (bits[frame / FRAME_WORD_BITS] >> (frame % FRAME_WORD_BITS)) & 1;
+}
+
+inline void SetFrameBit(uint64_t* bits, int frame){
+    bits[frame / FRAME_WORD_BITS] |= 1ull << (frame % FRAME_WORD_BITS);
+}
+
+inline void ClearFrameBit(uint64_t* bits, int frame){
+    bits[frame / FRAME_WORD_BITS] &= ~(1ull << (frame % FRAME_WORD_BITS));
+}
+
+// Returns the number of bitset words covering the frame table
+inline int FrameWordCount(){
+    return (frameTableSize + FRAME_WORD_BITS - 1) / FRAME_WORD_BITS;
+}
+
+inline std::atomic<long long> memoryAccesses{0}; // 64-bit: long runs and multi-pass replays pass 2^31 references
+inline std::atomic<long long> pageFaults{0};
+inline std::atomic<long long> pageWriteBacks{0}; // Dirty pages written to secondary storage
+inline std::atomic<int> poolFaults{0};           // Faults that found a free frame waiting
+inline std::atomic<int> synchronousEvictions{0}; // Faults that had to evict a page themselves
+inline std::atomic<int> backgroundWriteBacks{0}; // Dirty pages cleaned off the fault path, by the reclaimer or the WSClock hand
+inline std::atomic<int> prefetchedPages{0};      // Pages brought in alongside a faulting one
+inline std::atomic<int> prefetchHits{0};         // Prefetched pages referenced while resident
+inline std::atomic<int> prefetchWaste{0};        // Prefetched pages unmapped without ever being referenced
+inline std::atomic<int> sharedPageMappings{0};   // References that mapped a resident page of the shared image without a page-in
+inline std::atomic<int> copyOnWriteFaults{0};    // Writes that gave a process its own copy of a page of the shared image
+inline std::atomic<int> copyOnWriteCopies{0};    // Of which copied the page to a new frame rather than taking over its last mapping
+inline std::atomic<int> peakResidentFrames{0};   // Most frames ever holding a page at once
+
+// Prepaging, set with oss -a or replay -a
+inline int prefetchMode = PREFETCH_OFF;
+inline int prefetchPages = DEFAULT_PREFETCH_PAGES; // Cluster size, or the largest read-ahead window
+
+// Parses off, cluster[:pages] or readahead[:maxPages]; returns false, changing nothing, if it is not valid
+inline bool ParsePrefetch(const char* arg){
+    int pages = DEFAULT_PREFETCH_PAGES;
+    const char* colon = strchr(arg, ':');
+    size_t length = (colon != nullptr) ? (size_t)(colon - arg) : strlen(arg);
+    if(colon != nullptr && ((pages = atoi(colon + 1)) < 1)){
+        return false;
+    }
+    if(length == 3 && strncmp(arg, "off", 3) == 0 && colon == nullptr){
+        prefetchMode = PREFETCH_OFF;
+    } else if(length == 7 && strncmp(arg, "cluster", 7) == 0){
+        prefetchMode = PREFETCH_CLUSTER;
+    } else if(length == 9 && strncmp(arg, "readahead", 9) == 0){
+        prefetchMode = PREFETCH_READAHEAD;
+    } else {
+        return false;
+    }
+    prefetchPages = pages;
+    return true;
+}
+
+inline const char* PrefetchModeName(){
+    return (prefetchMode == PREFETCH_CLUSTER) ? "cluster" : (prefetchMode == PREFETCH_READAHEAD) ? "readahead" : "off";
+}
+
+// Byte streams state is saved to and loaded from for a checkpoint (checkpoint.h): plain values and arrays
+// of them, with every vector preceded by its length
+struct StateWriter {
+    std::vector<char> bytes;
+
+    template<typename T> void PutArray(const T* values, size_t count){
+        const char* data = (const char*)values;
+        bytes.insert(bytes.end(), data, data + sizeof(T) * count);
+    }
+    template<typename T> void Put(const T& value){
+        PutArray(&value, 1);
+    }
+    template<typename T> void PutVector(const std::vector<T>& values){
+        Put((uint64_t)values.size());
+        PutArray(values.data(), values.size());
+    }
+};
+
+// Reads what a StateWriter wrote; once a read runs past the end every later one fails too
+struct StateReader {
+    const char* data;
+    size_t size;
+    size_t position;
+    bool failed;
+
+    StateReader(const void* bytes, size_t length) : data((const char*)bytes), size(length), position(0), failed(false) {}
+    template<typename T> bool GetArray(T* values, size_t count){
+        size_t length = sizeof(T) * count;
+        if(failed || size - position < length){
+            failed = true;
+            return false;
+        }
+        memcpy((void*)values, data + position, length);
+        position += length;
+        return true;
+    }
+    template<typename T> bool Get(T* value){
+        return GetArray(value, 1);
+    }
+    // Reads a vector, which must have expected elements unless expected is negative
+    template<typename T> bool GetVector(std::vector<T>* values, long long expected = -1){
+        uint64_t count;
+        if(!Get(&count) || count > (size - position) / sizeof(T) || (expected >= 0 && count != (uint64_t)expected)){
+            failed = true;
+            return false;
+        }
+        values->resize(count);
+        return GetArray(values->data(), count);
+    }
+};
+
+// Interface every page-replacement policy implements. An instance manages one shard, whose frames it
+// numbers 0..frames-1; it reads and clears their reference and dirty bits through the helpers below
+// and keeps any other per-frame state in its own flat arrays
+struct ReplacementPolicy {
+    int frameBase = 0; // Frame table index of the shard's first frame
+    bool Resident(int frame) const { return TestFrameBit(frameTable.residentBits, frameBase + frame); }
+    bool Referenced(int frame) const { return TestFrameBit(frameTable.referenceBits, frameBase + frame); }
+    void ClearReferenced(int frame) { ClearFrameBit(frameTable.referenceBits, frameBase + frame); }
+    bool Dirty(int frame) const { return TestFrameBit(frameTable.dirtyBits, frameBase + frame); }
+    void ClearDirty(int frame) { ClearFrameBit(frameTable.dirtyBits, frameBase + frame); }
+    virtual ~ReplacementPolicy() {}
+    virtual const char* Name() const = 0;
+    virtual void Reset(int frames) = 0;                // Forget all history; every frame is free
+    virtual void OnMiss(pid_t pid, int pageNumber) {}  // A fault is about to bring this page in
+    virtual int SelectVictim() = 0;                    // Frame to evict; only called when none are free
+    virtual void OnEvict(int frame) {}                 // The frame's page is about to be unmapped for reuse
+    virtual void OnInsert(int frame) = 0;              // A page was just mapped into the frame
+    virtual void OnHit(int frame) {}                   // The resident page in the frame was referenced
+    virtual void OnFree(int frame) {}                  // The frame was released by an exiting process
+    virtual void SaveState(StateWriter* out) const {}  // Everything Reset would forget, for a checkpoint
+    virtual bool LoadState(StateReader* in) { return true; } // Called after Reset; false if the state does not fit
+    virtual void RenamePid(pid_t from, pid_t to) {}    // A process kept its pages but now runs under another pid
+};
+
+// Structures for a shard of the frame table: a contiguous run of frames with its own policy, free
+// pool and lock. Every virtual page hashes to one shard, so faults in different shards run in parallel.
+// Shards start on a bitset word boundary so that no two shards ever update the same word
+struct FrameShard {
+    std::mutex lock;
+    ReplacementPolicy* policy;
+    int firstFrame;
+    int frameCount;
+    int freeFrameCount; // The free frames are freeFrames[firstFrame .. firstFrame + freeFrameCount)
+    int lowWatermark;
+    int highWatermark;
+};
+
+inline FrameShard frameShards[MAX_FRAME_SHARDS];
+inline int frameShardCount = 1;
+inline bool frameShardLocking = false; // Set once more than one thread uses the tables
+
+// Returns how many shards the frame table can be split into given whole bitset words per shard
+inline int MaxFrameShardCount(){
+    return (FrameWordCount() < MAX_FRAME_SHARDS) ? FrameWordCount() : MAX_FRAME_SHARDS;
+}
+
+// Holds a shard's lock for the rest of a scope when the tables are shared between threads
+struct ShardGuard {
+    FrameShard* shard;
+    explicit ShardGuard(FrameShard* s) : shard(s) {
+        if(frameShardLocking) shard->lock.lock();
+    }
+    ~ShardGuard() {
+        if(frameShardLocking) shard->lock.unlock();
+    }
+};
+
+// Stacks of free frames, one per shard, handed out before the policy is asked for a victim
+inline int* freeFrames = nullptr;
+
+// Reclaim refills a pool once it drops below the low watermark and stops at the high one; 0 disables it
+// The watermarks cover the whole table and each shard gets its share
+inline int freeLowWatermark = 0;
+inline int freeHighWatermark = 0;
+
+// Global process table (not shared memory), sized by AllocateProcessTable
+inline ProcessControlBlock* processTable = nullptr;
+inline int processTableSize = 0;
+inline std::atomic<int>* processWriteBacks = nullptr; // Dirty pages written back, by the slot that owned them
+
+// Allocates a process table with the given number of slots
+inline void AllocateProcessTable(int slots){
+    delete[] processTable;
+    processTable = new ProcessControlBlock[slots]();
+    delete[] processWriteBacks;
+    processWriteBacks = new std::atomic<int>[slots]();
+    processTableSize = slots;
+}
+
+// Counts a dirty frame's page as written back, to the totals and to the process owning it
+inline void CountWriteBack(int frame){
+    pageWriteBacks++;
+    processWriteBacks[frameTable.ownerSlot[frame]]++;
+}
+
+// The frame table's bitsets and arrays, the frame holding each page of the shared image (-1 when it is
+// not resident) and every slot's page table, laid out as one block
+inline int32_t* sharedPageTable;
+inline int32_t* pageTables;
+
+// Returns the entries of a slot's page table: its pages, then its links for the shared image
+inline int PageTableStride(){
+    return pagesPerProcess + sharedPages;
+}
+
+// Returns the size of that block for a process table with the given number of slots
+inline size_t MemorySegmentSize(int slots){
+    return sizeof(uint64_t) * 4 * FrameWordCount() + sizeof(int32_t) * 3 * (size_t)frameTableSize
+           + sizeof(int32_t) * sharedPages + sizeof(int32_t) * (size_t)slots * PageTableStride();
+}
+
+// Points the frame table and page tables into a block of MemorySegmentSize bytes
+inline void LayoutMemorySegment(void* base){
+    frameTable.residentBits = (uint64_t*)base;
+    frameTable.referenceBits = frameTable.residentBits + FrameWordCount();
+    frameTable.dirtyBits = frameTable.referenceBits + FrameWordCount();
+    frameTable.prefetchBits = frameTable.dirtyBits + FrameWordCount();
+    frameTable.ownerSlot = (int32_t*)(frameTable.prefetchBits + FrameWordCount());
+    frameTable.pageNumber = frameTable.ownerSlot + frameTableSize;
+    frameTable.mapCount = frameTable.pageNumber + frameTableSize;
+    sharedPageTable = frameTable.mapCount + frameTableSize;
+    pageTables = sharedPageTable + sharedPages;
+    delete[] freeFrames;
+    freeFrames = new int[frameTableSize];
+}
+
+// Returns the frames of a shard when the table is split into frameShardCount shards of whole bitset words
+inline int ShardFrameCount(int s){
+    int words = FrameWordCount();
+    int first = s * words / frameShardCount * FRAME_WORD_BITS;
+    int end = (s + 1) * words / frameShardCount * FRAME_WORD_BITS;
+    return ((end < frameTableSize) ? end : frameTableSize) - first;
+}
+
+// Returns true if a prepaging window is smaller than every shard, so prepaging never fills a whole shard
+inline bool PrefetchFitsShards(){
+    for(int s = 0; s < frameShardCount && prefetchMode != PREFETCH_OFF; s++){
+        if(prefetchPages >= ShardFrameCount(s)){
+            return false;
+        }
+    }
+    return true;
+}
+
+// Initializes the frame table and the per-process page tables to default values
+inline void InitializePageTable(ProcessControlBlock processTable[]){
+    for(int w = 0; w < FrameWordCount(); w++){
+        frameTable.residentBits[w] = 0;
+        frameTable.referenceBits[w] = 0;
+        frameTable.dirtyBits[w] = 0;
+        frameTable.prefetchBits[w] = 0;
+    }
+    for(int i = 0; i < frameTableSize; i++){
+        frameTable.ownerSlot[i] = -1;
+        frameTable.pageNumber[i] = 0;
+        frameTable.mapCount[i] = 0;
+    }
+    for(int page = 0; page < sharedPages; page++){
+        sharedPageTable[page] = -1;
+    }
+    for(int i = 0; i < processTableSize; i++){
+        processTable[i].pageTable = &pageTables[(size_t)i * PageTableStride()];
+        processTable[i].readAheadNext = -1;
+        processTable[i].readAheadWindow = 0;
+        for(int j = 0; j < PageTableStride(); j++){
+            processTable[i].pageTable[j] = -1;
+        }
+    }
+    int words = FrameWordCount();
+    for(int s = 0; s < frameShardCount; s++){
+        FrameShard* shard = &frameShards[s];
+        shard->firstFrame = s * words / frameShardCount * FRAME_WORD_BITS;
+        shard->frameCount = ShardFrameCount(s);
+        shard->lowWatermark = (int)(((long long)freeLowWatermark * shard->frameCount + frameTableSize - 1) / frameTableSize);
+        shard->highWatermark = (int)(((long long)freeHighWatermark * shard->frameCount + frameTableSize - 1) / frameTableSize);
+        // Pushed in reverse so frames are handed out in ascending order
+        shard->freeFrameCount = 0;
+        for(int i = shard->firstFrame + shard->frameCount - 1; i >= shard->firstFrame; i--){
+            freeFrames[shard->firstFrame + shard->freeFrameCount++] = i;
+        }
+        if(shard->policy != nullptr){
+            shard->policy->frameBase = shard->firstFrame;
+            shard->policy->Reset(shard->frameCount);
+        }
+    }
+}
+
+// Returns the shard a virtual page of the process in a slot is always placed in. A page of the shared
+// image goes by its page number alone, so every process finds it, and the copies made of it, in one shard
+inline int PageShard(int slot, int pageNumber){
+    if(pageNumber < sharedPages){
+        return pageNumber % frameShardCount;
+    }
+    return (int)(((long long)slot * pagesPerProcess + pageNumber) % frameShardCount);
+}
+
+// Returns the number of free frames across every shard
+inline int FreeFrameCount(){
+    int count = 0;
+    for(int s = 0; s < frameShardCount; s++){
+        count += frameShards[s].freeFrameCount;
+    }
+    return count;
+}
+
+// Returns a slot's reverse-map link for a page of the shared image: the next slot mapping the same frame
+// (-1 after the last), or MAPPING_COPIED once the process has a copy of the page of its own
+inline int32_t* MapperLink(int slot, int pageNumber){
+    return &processTable[slot].pageTable[pagesPerProcess + pageNumber];
+}
+
+// Returns true if a fault on a page of a slot brings in the shared image's page rather than the process's own
+inline bool MapsSharedImage(int slot, int pageNumber){
+    return pageNumber < sharedPages && *MapperLink(slot, pageNumber) != MAPPING_COPIED;
+}
+
+// Returns true if a resident frame holds a page of the shared image
+inline bool SharedFrame(int frame){
+    int pageNumber = frameTable.pageNumber[frame];
+    return pageNumber < sharedPages && sharedPageTable[pageNumber] == frame;
+}
+
+// Raises the peak of resident frames to the frames in use now
+inline void NoteResidentFrames(){
+    int resident = frameTableSize - FreeFrameCount();
+    int peak = peakResidentFrames;
+    while(resident > peak && !peakResidentFrames.compare_exchange_weak(peak, resident)){
+    }
+}
+
+// Returns the pid owning a frame, or 0 for a free frame or a page of the shared image, which no one
+// process owns
+inline pid_t FramePid(int frame){
+    int slot = frameTable.ownerSlot[frame];
+    return (slot == -1 || SharedFrame(frame)) ? 0 : processTable[slot].pid;
+}
+
+// Returns the pid the policies know a page of a slot by, matching FramePid once it is resident
+inline pid_t PagePid(int slot, int pageNumber){
+    return MapsSharedImage(slot, pageNumber) ? 0 : processTable[slot].pid;
+}
+
+// Maps a page of the process in the given slot to a frame, referenced and dirty if written. A page of
+// the shared image becomes the image's, unless it is written or the process already has its own copy
+inline void MapFrame(int frame, int slot, int pageNumber, bool dirty){
+    frameTable.ownerSlot[frame] = slot;
+    frameTable.pageNumber[frame] = pageNumber;
+    frameTable.mapCount[frame] = 1;
+    SetFrameBit(frameTable.residentBits, frame);
+    SetFrameBit(frameTable.referenceBits, frame);
+    if(dirty){
+        SetFrameBit(frameTable.dirtyBits, frame);
+    } else {
+        ClearFrameBit(frameTable.dirtyBits, frame);
+    }
+    if(pageNumber < sharedPages){
+        bool shared = !dirty && MapsSharedImage(slot, pageNumber);
+        *MapperLink(slot, pageNumber) = shared ? -1 : MAPPING_COPIED;
+        if(shared){
+            sharedPageTable[pageNumber] = frame;
+        }
+    }
+    processTable[slot].pageTable[pageNumber] = frame;
+}
+
+// Maps a resident page of the shared image into one more process's page table
+inline void AddFrameMapper(int frame, int slot){
+    int pageNumber = frameTable.pageNumber[frame];
+    *MapperLink(slot, pageNumber) = frameTable.ownerSlot[frame];
+    frameTable.ownerSlot[frame] = slot;
+    frameTable.mapCount[frame]++;
+    processTable[slot].pageTable[pageNumber] = frame;
+}
+
+// Unmaps a shared frame from one process's page table, leaving it to the others; it must have others
+inline void RemoveFrameMapper(int frame, int slot){
+    int pageNumber = frameTable.pageNumber[frame];
+    int32_t* link = &frameTable.ownerSlot[frame];
+    while(*link != slot){
+        link = MapperLink(*link, pageNumber);
+    }
+    *link = *MapperLink(slot, pageNumber);
+    *MapperLink(slot, pageNumber) = -1;
+    frameTable.mapCount[frame]--;
+    processTable[slot].pageTable[pageNumber] = -1;
+    if(tlbEntries > 0){
+        TlbInvalidate(slot, pageNumber);
+    }
+}
+
+// Unmaps whatever page occupies a frame, invalidating the entry of every process mapping it and leaving
+// the frame free
+inline void UnmapFrame(int frame){
+    int slot = frameTable.ownerSlot[frame];
+    if(slot == -1){
+        return;
+    }
+    int pageNumber = frameTable.pageNumber[frame];
+    bool shared = SharedFrame(frame);
+    if(shared){
+        sharedPageTable[pageNumber] = -1;
+    }
+    while(slot != -1){
+        processTable[slot].pageTable[pageNumber] = -1;
+        if(tlbEntries > 0){
+            TlbInvalidate(slot, pageNumber);
+        }
+        int next = -1;
+        if(shared){
+            next = *MapperLink(slot, pageNumber);
+            *MapperLink(slot, pageNumber) = -1;
+        }
+        slot = next;
+    }
+    if(TestFrameBit(frameTable.prefetchBits, frame)){
+        ClearFrameBit(frameTable.prefetchBits, frame);
+        prefetchWaste++;
+    }
+    ClearFrameBit(frameTable.residentBits, frame);
+    ClearFrameBit(frameTable.referenceBits, frame);
+    ClearFrameBit(frameTable.dirtyBits, frame);
+    frameTable.ownerSlot[frame] = -1;
+    frameTable.pageNumber[frame] = 0;
+    frameTable.mapCount[frame] = 0;
+}
+
+// Frees every frame held by a process by walking its page table; pages of the shared image that other
+// processes still map stay resident for them
+inline void ReleaseProcessFrames(ProcessControlBlock* pcb){
+    int slot = (int)(pcb - processTable);
+    for(int page = 0; page < pagesPerProcess; page++){
+        if(pcb->pageTable[page] == -1){
+            continue;
+        }
+        FrameShard* shard = &frameShards[PageShard(slot, page)];
+        ShardGuard guard(shard);
+        int frame = pcb->pageTable[page];
+        if(frameTable.mapCount[frame] > 1){
+            RemoveFrameMapper(frame, slot);
+            continue;
+        }
+        shard->policy->OnFree(frame - shard->firstFrame);
+        UnmapFrame(frame);
+        freeFrames[shard->firstFrame + shard->freeFrameCount++] = frame;
+    }
+    TlbFlush(slot);
+    pcb->readAheadNext = -1;
+    pcb->readAheadWindow = 0;
+}
+
+// Lets a new process in a slot start out mapping the whole shared image, forgetting the copies the
+// slot's previous process made; its frames must already have been released
+inline void ResetSharedMappings(int slot){
+    for(int page = 0; page < sharedPages; page++){
+        *MapperLink(slot, page) = -1;
+    }
+}
+
+// Tells the shard's policy a frame's page is leaving and unmaps it, leaving the frame free
+inline void EvictFrame(FrameShard* shard, int frame){
+    shard->policy->OnEvict(frame - shard->firstFrame);
+    UnmapFrame(frame);
+}
+
+// Takes a frame of a shard for an incoming page: a free one, or the policy's victim once it has been
+// evicted (and written back if dirty). Sets evicted to which it was; the caller holds the shard's lock
+inline int TakeFrame(FrameShard* shard, bool* evicted){
+    if(shard->freeFrameCount > 0){
+        *evicted = false;
+        return freeFrames[shard->firstFrame + --shard->freeFrameCount];
+    }
+    int frame = shard->firstFrame + shard->policy->SelectVictim();
+    if(TestFrameBit(frameTable.dirtyBits, frame)){
+        CountWriteBack(frame);
+        LogPrintf(LOG_INFO, LOG_CAT_FAULT, "OSS: Swapping out dirty frame, saving to secondary storage...\n");
+    }
+    EvictFrame(shard, frame);
+    *evicted = true;
+    return frame;
+}
+
+// Gives a process writing a page of the shared image it maps a copy of its own: the last process mapping
+// the page takes the frame over, any other gets a new frame of the same shard. The new frame's victim may
+// be the shared frame itself, whose page is then copied before it goes. Returns the frame the process
+// now maps; the caller holds the shard's lock
+inline int CopyOnWrite(FrameShard* shard, int slot, int pageNumber){
+    int frame = processTable[slot].pageTable[pageNumber];
+    copyOnWriteFaults++;
+    if(frameTable.mapCount[frame] == 1){
+        sharedPageTable[pageNumber] = -1;
+        *MapperLink(slot, pageNumber) = MAPPING_COPIED;
+        return frame;
+    }
+    bool evicted;
+    int copy = TakeFrame(shard, &evicted);
+    if(processTable[slot].pageTable[pageNumber] == frame){
+        RemoveFrameMapper(frame, slot);
+    }
+    MapFrame(copy, slot, pageNumber, true);
+    shard->policy->OnInsert(copy - shard->firstFrame);
+    if(tlbEntries > 0){
+        TlbInvalidate(slot, pageNumber);
+        TlbInsert(slot, pageNumber, copy);
+    }
+    copyOnWriteCopies++;
+    NoteResidentFrames();
+    return copy;
+}
+
+// Handles a page fault by taking a free frame from the page's shard, or evicting the shard policy's
+// victim, and mapping the page; the caller holds the shard's lock. A page of the shared image that
+// another process brought in meanwhile is mapped where it is, or copied if this is a write
+inline void HandlePageFault(int slot, int pageNumber, int msgCode){
+    FrameShard* shard = &frameShards[PageShard(slot, pageNumber)];
+    if(MapsSharedImage(slot, pageNumber) && sharedPageTable[pageNumber] != -1){
+        int frame = sharedPageTable[pageNumber];
+        AddFrameMapper(frame, slot);
+        if(msgCode == MSG_WRITE){
+            frame = CopyOnWrite(shard, slot, pageNumber);
+        }
+        SetFrameBit(frameTable.referenceBits, frame);
+        shard->policy->OnHit(frame - shard->firstFrame);
+        return;
+    }
+    shard->policy->OnMiss(PagePid(slot, pageNumber), pageNumber);
+
+    bool evicted;
+    int frame = TakeFrame(shard, &evicted);
+    if(evicted){
+        synchronousEvictions++;
+    } else {
+        poolFaults++;
+    }
+    MapFrame(frame, slot, pageNumber, msgCode == MSG_WRITE);
+    shard->policy->OnInsert(frame - shard->firstFrame);
+}
+
+// Prepages around a fault on a page of the process in a slot: the rest of the page's cluster, or, for
+// read-ahead, a window of following pages that doubles (up to prefetchPages) each time a fault lands
+// just past the previous window and collapses to nothing on any other fault. Prefetched pages are
+// mapped clean with their reference bit clear, so the policy reclaims them first if they go unused.
+// Being speculative they only ever take free frames: a page whose shard has none is skipped rather than
+// evicting anything, least of all the page that just faulted. Returns the pages brought in; the caller
+// holds no shard lock
+inline int PrefetchPages(int slot, int pageNumber){
+    ProcessControlBlock* pcb = &processTable[slot];
+    int first, count;
+    if(prefetchMode == PREFETCH_CLUSTER){
+        first = pageNumber / prefetchPages * prefetchPages;
+        count = prefetchPages;
+    } else {
+        if(pageNumber == pcb->readAheadNext){
+            int grown = pcb->readAheadWindow * 2;
+            pcb->readAheadWindow = (grown < 1) ? 1 : (grown > prefetchPages) ? prefetchPages : grown;
+        } else {
+            pcb->readAheadWindow = 0;
+        }
+        first = pageNumber + 1;
+        count = pcb->readAheadWindow;
+        pcb->readAheadNext = pageNumber + count + 1;
+    }
+
+    int brought = 0;
+    for(int page = first; page < first + count && page < pagesPerProcess; page++){
+        if(page == pageNumber){
+            continue;
+        }
+        FrameShard* shard = &frameShards[PageShard(slot, page)];
+        ShardGuard guard(shard);
+        if(pcb->pageTable[page] != -1){
+            continue;
+        }
+        if(MapsSharedImage(slot, page) && sharedPageTable[page] != -1){
+            AddFrameMapper(sharedPageTable[page], slot); // Already in memory, so there is nothing to read
+            continue;
+        }
+        if(shard->freeFrameCount == 0){
+            continue;
+        }
+        shard->policy->OnMiss(PagePid(slot, page), page);
+        int frame = freeFrames[shard->firstFrame + --shard->freeFrameCount];
+        MapFrame(frame, slot, page, false);
+        ClearFrameBit(frameTable.referenceBits, frame);
+        SetFrameBit(frameTable.prefetchBits, frame);
+        shard->policy->OnInsert(frame - shard->firstFrame);
+        brought++;
+    }
+    prefetchedPages += brought;
+    return brought;
+}
+
+// Returns true when some shard's free pool has fallen below its low watermark
+inline bool ReclaimNeeded(){
+    for(int s = 0; s < frameShardCount; s++){
+        if(frameShards[s].freeFrameCount < frameShards[s].lowWatermark){
+            return true;
+        }
+    }
+    return false;
+}
+
+// Returns true once every shard's free pool is back up to its high watermark
+inline bool ReclaimComplete(){
+    for(int s = 0; s < frameShardCount; s++){
+        if(frameShards[s].freeFrameCount < frameShards[s].highWatermark){
+            return false;
+        }
+    }
+    return true;
+}
+
+// Background reclaim: moves policy victims into each shard's free pool until it reaches the high
+// watermark or limit frames of that shard have been examined. A dirty victim is written back and left
+// resident, so the policy can pick it again once clean (or spare it if it is referenced meanwhile).
+// Returns frames freed
+inline int ReclaimFrames(int limit){
+    int freed = 0;
+    for(int s = 0; s < frameShardCount; s++){
+        FrameShard* shard = &frameShards[s];
+        ShardGuard guard(shard);
+        for(int i = 0; i < limit && shard->freeFrameCount < shard->highWatermark && shard->freeFrameCount < shard->frameCount; i++){
+            int frame = shard->firstFrame + shard->policy->SelectVictim();
+            if(TestFrameBit(frameTable.dirtyBits, frame)){
+                ClearFrameBit(frameTable.dirtyBits, frame);
+                CountWriteBack(frame);
+                backgroundWriteBacks++;
+                LogPrintf(LOG_DEBUG, LOG_CAT_FAULT, "OSS: Reclaim writing back dirty frame %d\n", frame);
+                continue;
+            }
+            EvictFrame(shard, frame);
+            freeFrames[shard->firstFrame + shard->freeFrameCount++] = frame;
+            freed++;
+        }
+    }
+    return freed;
+}
+
+// Resolves a reference to a resident page, setting its reference and dirty bits; returns false on a miss
+// The slot's TLB is consulted first and, on a TLB miss, filled from the page table; tlbHit, if given, is
+// set to whether the translation came from the TLB. A page of the shared image that is in memory counts
+// as resident even before the process maps it, and a write to it is given a copy of its own
+inline bool ReferenceResidentPage(int slot, int memoryAddress, int msgCode, bool* tlbHit = nullptr){
+    int pageNumber = PageNumber(memoryAddress);
+    FrameShard* shard = &frameShards[PageShard(slot, pageNumber)];
+    ShardGuard guard(shard);
+    int frame = (tlbEntries > 0) ? TlbLookup(slot, pageNumber) : -1;
+    if(tlbHit != nullptr){
+        *tlbHit = frame != -1;
+    }
+    if(frame == -1){
+        frame = processTable[slot].pageTable[pageNumber];
+        if(frame == -1 && MapsSharedImage(slot, pageNumber) && sharedPageTable[pageNumber] != -1){
+            frame = sharedPageTable[pageNumber];
+            AddFrameMapper(frame, slot);
+            sharedPageMappings++;
+        }
+        if(frame == -1){
+            return false;
+        }
+        if(tlbEntries > 0){
+            TlbInsert(slot, pageNumber, frame);
+        }
+    }
+    if(TestFrameBit(frameTable.prefetchBits, frame)){
+        ClearFrameBit(frameTable.prefetchBits, frame);
+        prefetchHits++;
+    }
+    if(msgCode == MSG_WRITE && SharedFrame(frame)){
+        frame = CopyOnWrite(shard, slot, pageNumber);
+    }
+    if(msgCode == MSG_WRITE)
+        SetFrameBit(frameTable.dirtyBits, frame);
+    SetFrameBit(frameTable.referenceBits, frame);
+    shard->policy->OnHit(frame - shard->firstFrame);
+    memoryAccesses++;
+    return true;
+}
+
+// Brings in the page a missed reference needs, and any pages prepaged with it, and counts the fault;
+// returns the frame the page now occupies
+inline int CompletePageFault(int slot, int memoryAddress, int msgCode){
+    int pageNumber = PageNumber(memoryAddress);
+    int frame;
+    {
+        ShardGuard guard(&frameShards[PageShard(slot, pageNumber)]);
+        HandlePageFault(slot, pageNumber, msgCode);
+        pageFaults++;
+        memoryAccesses++;
+        frame = processTable[slot].pageTable[pageNumber];
+        if(tlbEntries > 0){
+            TlbInsert(slot, pageNumber, frame);
+        }
+    }
+    if(prefetchMode != PREFETCH_OFF){
+        PrefetchPages(slot, pageNumber);
+    }
+    NoteResidentFrames();
+    return frame;
+}
+
+// Resolves one memory reference, faulting the page in at once on a miss; returns false if it faulted
+inline bool HandlePageRequest(int slot, int memoryAddress, int msgCode){
+    if(ReferenceResidentPage(slot, memoryAddress, msgCode)){
+        return true;
+    }
+    CompletePageFault(slot, memoryAddress, msgCode);
+    return false;
+}
+
+#endif
@@ -0,0 +1,788 @@
+// Page-replacement policies for the pager, selected by name with oss -P or replay -P
+// Every policy keeps its per-frame metadata in flat arrays indexed by its shard's frame numbers.
+// SelectVictim must return a resident frame: background reclaim calls it while some frames are free
+#ifndef POLICY_H
+#define POLICY_H
+
+#include <stdint.h>
+#include <string.h>
+#include <vector>
+#include "pager.h"
+
+#define AGING_TICK_REFERENCES 128 // References between shifts of the aging counters
+#define WSCLOCK_TAU_FACTOR 4      // WSClock working-set window, in references per frame
+#define CLOCKPRO_COLD_DIVISOR 10  // CLOCK-Pro starts with this fraction of frames reserved for cold pages
+
+// Identifies a virtual page across processes, for policies that remember evicted pages
+inline uint64_t PageKey(pid_t pid, int pageNumber){
+    return ((uint64_t)(uint32_t)pid << 32) | (uint32_t)pageNumber;
+}
+
+// Identifies the page currently held in a frame (a frame table index, not a policy's own numbering)
+inline uint64_t FramePageKey(int frame){
+    return PageKey(FramePid(frame), frameTable.pageNumber[frame]);
+}
+
+// Doubly linked queue of frames threaded through flat prev/next arrays; the front is the oldest
+struct FrameQueue {
+    std::vector<int> prev;
+    std::vector<int> next;
+    std::vector<char> queued;
+    int head;
+    int tail;
+    int size;
+
+    void Reset(int frames){
+        prev.assign(frames, -1);
+        next.assign(frames, -1);
+        queued.assign(frames, 0);
+        head = tail = -1;
+        size = 0;
+    }
+
+    void PushBack(int frame){
+        prev[frame] = tail;
+        next[frame] = -1;
+        if(tail != -1){
+            next[tail] = frame;
+        } else {
+            head = frame;
+        }
+        tail = frame;
+        queued[frame] = 1;
+        size++;
+    }
+
+    void Remove(int frame){
+        if(!queued[frame]){
+            return;
+        }
+        if(prev[frame] != -1){
+            next[prev[frame]] = next[frame];
+        } else {
+            head = next[frame];
+        }
+        if(next[frame] != -1){
+            prev[next[frame]] = prev[frame];
+        } else {
+            tail = prev[frame];
+        }
+        queued[frame] = 0;
+        size--;
+    }
+
+    bool Contains(int frame) const {
+        return queued[frame] != 0;
+    }
+
+    void Save(StateWriter* out) const {
+        out->PutVector(prev);
+        out->PutVector(next);
+        out->PutVector(queued);
+        out->Put(head);
+        out->Put(tail);
+        out->Put(size);
+    }
+
+    bool Load(StateReader* in, int frames){
+        return in->GetVector(&prev, frames) && in->GetVector(&next, frames) && in->GetVector(&queued, frames) &&
+               in->Get(&head) && in->Get(&tail) && in->Get(&size);
+    }
+};
+
+// Bounded FIFO of page keys no longer resident, with an open-addressed index for membership tests
+// Pushing onto a full list drops its oldest key
+struct GhostList {
+    std::vector<uint64_t> keys;
+    std::vector<int> prev;
+    std::vector<int> next;
+    std::vector<int> buckets; // Node index per bucket, -1 when empty
+    int mask;
+    int capacity;
+    int head;
+    int tail;
+    int size;
+    int freeHead;
+
+    void Reset(int limit){
+        capacity = (limit > 0) ? limit : 1;
+        keys.assign(capacity, 0);
+        prev.assign(capacity, -1);
+        next.assign(capacity, -1);
+        int count = 1;
+        while(count < capacity * 2){
+            count <<= 1;
+        }
+        buckets.assign(count, -1);
+        mask = count - 1;
+        head = tail = -1;
+        size = 0;
+        for(int i = 0; i < capacity; i++){
+            next[i] = (i + 1 < capacity) ? i + 1 : -1;
+        }
+        freeHead = 0;
+    }
+
+    int HomeBucket(uint64_t key) const {
+        return (int)((key * 0x9E3779B97F4A7C15ull) >> 32) & mask;
+    }
+
+    // Returns the bucket holding key, or -1
+    int FindBucket(uint64_t key) const {
+        for(int b = HomeBucket(key); buckets[b] != -1; b = (b + 1) & mask){
+            if(keys[buckets[b]] == key){
+                return b;
+            }
+        }
+        return -1;
+    }
+
+    bool Contains(uint64_t key) const {
+        return FindBucket(key) != -1;
+    }
+
+    // Empties a bucket and shifts later entries of the probe run back so lookups stay correct
+    void EraseBucket(int b){
+        buckets[b] = -1;
+        for(int j = (b + 1) & mask; buckets[j] != -1; j = (j + 1) & mask){
+            int home = HomeBucket(keys[buckets[j]]);
+            if(((j - home) & mask) >= ((j - b) & mask)){
+                buckets[b] = buckets[j];
+                buckets[j] = -1;
+                b = j;
+            }
+        }
+    }
+
+    void Remove(uint64_t key){
+        int b = FindBucket(key);
+        if(b == -1){
+            return;
+        }
+        int node = buckets[b];
+        EraseBucket(b);
+        if(prev[node] != -1){
+            next[prev[node]] = next[node];
+        } else {
+            head = next[node];
+        }
+        if(next[node] != -1){
+            prev[next[node]] = prev[node];
+        } else {
+            tail = prev[node];
+        }
+        next[node] = freeHead;
+        freeHead = node;
+        size--;
+    }
+
+    void PopFront(){
+        if(head != -1){
+            Remove(keys[head]);
+        }
+    }
+
+    void PushBack(uint64_t key){
+        if(size == capacity){
+            PopFront();
+        }
+        int node = freeHead;
+        freeHead = next[node];
+        keys[node] = key;
+        prev[node] = tail;
+        next[node] = -1;
+        if(tail != -1){
+            next[tail] = node;
+        } else {
+            head = node;
+        }
+        tail = node;
+        int b = HomeBucket(key);
+        while(buckets[b] != -1){
+            b = (b + 1) & mask;
+        }
+        buckets[b] = node;
+        size++;
+    }
+
+    void Save(StateWriter* out) const {
+        out->Put(capacity);
+        out->PutVector(keys);
+        out->PutVector(prev);
+        out->PutVector(next);
+        out->PutVector(buckets);
+        out->Put(mask);
+        out->Put(head);
+        out->Put(tail);
+        out->Put(size);
+        out->Put(freeHead);
+    }
+
+    bool Load(StateReader* in){
+        int saved;
+        if(!in->Get(&saved) || saved != capacity){
+            return false;
+        }
+        return in->GetVector(&keys, capacity) && in->GetVector(&prev, capacity) && in->GetVector(&next, capacity) &&
+               in->GetVector(&buckets, (long long)buckets.size()) && in->Get(&mask) && in->Get(&head) &&
+               in->Get(&tail) && in->Get(&size) && in->Get(&freeHead);
+    }
+
+    // Moves every key of one pid to another, keeping their order
+    void RenamePid(pid_t from, pid_t to){
+        std::vector<uint64_t> live;
+        for(int node = head; node != -1; node = next[node]){
+            live.push_back(keys[node]);
+        }
+        Reset(capacity);
+        for(uint64_t key : live){
+            if((pid_t)(key >> 32) == from){
+                key = PageKey(to, (int)(uint32_t)key);
+            }
+            PushBack(key);
+        }
+    }
+};
+
+// First-in first-out: evicts the page that has been resident longest
+struct FifoPolicy : ReplacementPolicy {
+    FrameQueue queue;
+
+    const char* Name() const override { return "fifo"; }
+    void Reset(int frames) override { queue.Reset(frames); }
+    int SelectVictim() override { return queue.head; }
+    void OnEvict(int frame) override { queue.Remove(frame); }
+    void OnInsert(int frame) override { queue.PushBack(frame); }
+    void OnFree(int frame) override { queue.Remove(frame); }
+    void SaveState(StateWriter* out) const override { queue.Save(out); }
+    bool LoadState(StateReader* in) override { return queue.Load(in, (int)queue.queued.size()); }
+};
+
+// Advances a clock hand over frames 0..frames-1 of word-aligned resident and reference bitsets until it
+// reaches a resident frame without its reference bit, clearing the reference bits of the resident frames
+// it passes, and returns that frame. The result and the bits left behind are exactly those of moving the
+// hand one frame at a time, but each step examines a whole word: the candidates in it are resident &
+// ~referenced, the first is found with count-trailing-zeros and everything before it is cleared at once.
+// At least one frame must be resident
+inline int ClockSweep(const uint64_t* residentBits, uint64_t* referenceBits, int frames, int* hand){
+    int words = (frames + FRAME_WORD_BITS - 1) / FRAME_WORD_BITS;
+    int word = *hand / FRAME_WORD_BITS;
+    uint64_t from = ~0ull << (*hand % FRAME_WORD_BITS); // Bits at or after the hand
+    while(true){
+        uint64_t resident = residentBits[word];
+        if(word == words - 1 && frames % FRAME_WORD_BITS != 0){
+            resident &= (1ull << (frames % FRAME_WORD_BITS)) - 1;
+        }
+        uint64_t candidates = resident & ~referenceBits[word] & from;
+        if(candidates != 0){
+            int bit = __builtin_ctzll(candidates);
+            uint64_t passed = from & ((1ull << bit) - 1);
+            referenceBits[word] &= ~passed;
+            int frame = word * FRAME_WORD_BITS + bit;
+            *hand = (frame + 1 == frames) ? 0 : frame + 1;
+            return frame;
+        }
+        referenceBits[word] &= ~(resident & from);
+        word = (word + 1 == words) ? 0 : word + 1;
+        from = ~0ull;
+    }
+}
+
+// Second chance (clock): the hand clears reference bits until it finds a page without one. The sweep
+// works a bitset word at a time (see ClockSweep), which matters once nearly every bit is set
+struct ClockPolicy : ReplacementPolicy {
+    int frames;
+    int hand;
+
+    const char* Name() const override { return "clock"; }
+    void Reset(int count) override {
+        frames = count;
+        hand = 0;
+    }
+    void SaveState(StateWriter* out) const override { out->Put(hand); }
+    bool LoadState(StateReader* in) override { return in->Get(&hand) && hand >= 0 && hand < frames; }
+    int SelectVictim() override {
+        // Shards start on a word boundary, so the shard's frame 0 is bit 0 of a word
+        int word = frameBase / FRAME_WORD_BITS;
+        return ClockSweep(frameTable.residentBits + word, frameTable.referenceBits + word, frames, &hand);
+    }
+    void OnInsert(int frame) override {}
+};
+
+// Enhanced NRU (enhanced second chance): prefers unreferenced clean pages, then unreferenced dirty
+// ones, clearing reference bits on the second kind of sweep so a later round always succeeds
+struct NruPolicy : ReplacementPolicy {
+    int frames;
+    int hand;
+
+    const char* Name() const override { return "nru"; }
+    void Reset(int count) override {
+        frames = count;
+        hand = 0;
+    }
+    void SaveState(StateWriter* out) const override { out->Put(hand); }
+    bool LoadState(StateReader* in) override { return in->Get(&hand) && hand >= 0 && hand < frames; }
+    int SelectVictim() override {
+        while(true){
+            // Look for (unreferenced, clean) without touching any bits
+            for(int i = 0; i < frames; i++){
+                int frame = (hand + i) % frames;
+                if(Resident(frame) && !Referenced(frame) && !Dirty(frame)){
+                    hand = (frame + 1) % frames;
+                    return frame;
+                }
+            }
+            // Look for (unreferenced, dirty), clearing reference bits along the way
+            for(int i = 0; i < frames; i++){
+                int frame = (hand + i) % frames;
+                if(!Resident(frame)){
+                    continue;
+                }
+                if(!Referenced(frame)){
+                    hand = (frame + 1) % frames;
+                    return frame;
+                }
+                ClearReferenced(frame);
+            }
+        }
+    }
+    void OnInsert(int frame) override {}
+};
+
+// Aging: every AGING_TICK_REFERENCES references each frame's counter shifts right and takes the
+// reference bit as its top bit; the page with the smallest counter approximates least recently used
+struct AgingPolicy : ReplacementPolicy {
+    std::vector<uint8_t> age;
+    int frames;
+    int hand; // Where the next search starts, so ties do not always fall on low frames
+    int references;
+
+    const char* Name() const override { return "aging"; }
+    void Reset(int count) override {
+        frames = count;
+        age.assign(count, 0);
+        hand = 0;
+        references = 0;
+    }
+    void SaveState(StateWriter* out) const override {
+        out->PutVector(age);
+        out->Put(hand);
+        out->Put(references);
+    }
+    bool LoadState(StateReader* in) override {
+        return in->GetVector(&age, frames) && in->Get(&hand) && in->Get(&references);
+    }
+    void Tick(){
+        if(++references < AGING_TICK_REFERENCES){
+            return;
+        }
+        references = 0;
+        for(int frame = 0; frame < frames; frame++){
+            if(Resident(frame)){
+                age[frame] = (age[frame] >> 1) | (Referenced(frame) ? 0x80 : 0);
+                ClearReferenced(frame);
+            }
+        }
+    }
+    int SelectVictim() override {
+        int victim = -1;
+        for(int i = 0; i < frames; i++){
+            int frame = (hand + i) % frames;
+            if(Resident(frame) && (victim == -1 || age[frame] < age[victim])){
+                victim = frame;
+            }
+        }
+        hand = (victim + 1) % frames;
+        return victim;
+    }
+    void OnInsert(int frame) override {
+        age[frame] = 0x80;
+        Tick();
+    }
+    void OnHit(int frame) override { Tick(); }
+};
+
+// WSClock: the clock hand evicts clean pages that fall outside the working-set window, and starts
+// write-backs for dirty ones so they are clean by the time the hand comes round again
+struct WsClockPolicy : ReplacementPolicy {
+    std::vector<uint64_t> lastUse; // Virtual time, in references, of the last observed use
+    int frames;
+    int hand;
+    uint64_t now;
+    uint64_t tau;
+
+    const char* Name() const override { return "wsclock"; }
+    void Reset(int count) override {
+        frames = count;
+        lastUse.assign(count, 0);
+        hand = 0;
+        now = 0;
+        tau = (uint64_t)count * WSCLOCK_TAU_FACTOR;
+    }
+    void SaveState(StateWriter* out) const override {
+        out->PutVector(lastUse);
+        out->Put(hand);
+        out->Put(now);
+    }
+    bool LoadState(StateReader* in) override {
+        return in->GetVector(&lastUse, frames) && in->Get(&hand) && in->Get(&now);
+    }
+    int SelectVictim() override {
+        int firstClean = -1;
+        for(int i = 0; i < 2 * frames; i++){
+            int frame = hand;
+            hand = (hand + 1 == frames) ? 0 : hand + 1;
+            if(!Resident(frame)){
+                continue;
+            }
+            if(Referenced(frame)){
+                ClearReferenced(frame);
+                lastUse[frame] = now;
+                continue;
+            }
+            if(now - lastUse[frame] <= tau){
+                if(firstClean == -1 && !Dirty(frame)){
+                    firstClean = frame;
+                }
+                continue;
+            }
+            if(!Dirty(frame)){
+                return frame;
+            }
+            ClearDirty(frame);
+            CountWriteBack(frameBase + frame);
+            backgroundWriteBacks++;
+        }
+        // Everything is in the working set; settle for a clean page, or whatever the hand is on
+        if(firstClean != -1){
+            return firstClean;
+        }
+        while(true){
+            int frame = hand;
+            hand = (hand + 1 == frames) ? 0 : hand + 1;
+            if(Resident(frame)){
+                return frame;
+            }
+        }
+    }
+    void OnInsert(int frame) override { lastUse[frame] = ++now; }
+    void OnHit(int frame) override { now++; }
+};
+
+// CLOCK-Pro, simplified: resident pages are hot or cold, and a cold page stays "in test" for one
+// round of the cold hand; re-referencing a cold page in test, or faulting on one recently evicted
+// from test, promotes it to hot and grows the cold allocation's target
+struct ClockProPolicy : ReplacementPolicy {
+    std::vector<char> hot;
+    std::vector<char> inTest;
+    GhostList nonResident; // Cold pages evicted while still in test
+    int frames;
+    int coldHand;
+    int hotHand;
+    int hotCount;
+    int coldTarget;
+    bool wasNonResident;
+
+    const char* Name() const override { return "clockpro"; }
+    void Reset(int count) override {
+        frames = count;
+        hot.assign(count, 0);
+        inTest.assign(count, 0);
+        nonResident.Reset(count);
+        coldHand = hotHand = 0;
+        hotCount = 0;
+        coldTarget = (count / CLOCKPRO_COLD_DIVISOR > 0) ? count / CLOCKPRO_COLD_DIVISOR : 1;
+        wasNonResident = false;
+    }
+    void SaveState(StateWriter* out) const override {
+        out->PutVector(hot);
+        out->PutVector(inTest);
+        nonResident.Save(out);
+        out->Put(coldHand);
+        out->Put(hotHand);
+        out->Put(hotCount);
+        out->Put(coldTarget);
+        out->Put(wasNonResident);
+    }
+    bool LoadState(StateReader* in) override {
+        return in->GetVector(&hot, frames) && in->GetVector(&inTest, frames) && nonResident.Load(in) &&
+               in->Get(&coldHand) && in->Get(&hotHand) && in->Get(&hotCount) && in->Get(&coldTarget) &&
+               in->Get(&wasNonResident);
+    }
+    void RenamePid(pid_t from, pid_t to) override { nonResident.RenamePid(from, to); }
+    // Advances the hot hand until one hot page has been demoted, ending expired test periods on the way
+    void RunHotHand(){
+        for(int i = 0; i < 2 * frames + 1; i++){
+            int frame = hotHand;
+            hotHand = (hotHand + 1 == frames) ? 0 : hotHand + 1;
+            if(!Resident(frame)){
+                continue;
+            }
+            if(hot[frame]){
+                if(Referenced(frame)){
+                    ClearReferenced(frame);
+                } else {
+                    hot[frame] = 0;
+                    hotCount--;
+                    return;
+                }
+            } else if(inTest[frame] && !Referenced(frame)){
+                inTest[frame] = 0;
+                if(coldTarget > 1){
+                    coldTarget--;
+                }
+            }
+        }
+    }
+    void Promote(int frame){
+        hot[frame] = 1;
+        inTest[frame] = 0;
+        hotCount++;
+        if(hotCount > frames - coldTarget){
+            RunHotHand();
+        }
+    }
+    void OnMiss(pid_t pid, int pageNumber) override {
+        uint64_t key = PageKey(pid, pageNumber);
+        wasNonResident = nonResident.Contains(key);
+        if(wasNonResident){
+            nonResident.Remove(key);
+            if(coldTarget < frames - 1){
+                coldTarget++;
+            }
+        }
+    }
+    int SelectVictim() override {
+        if(hotCount == frames){
+            RunHotHand();
+        }
+        for(int i = 0; i < 3 * frames; i++){
+            int frame = coldHand;
+            coldHand = (coldHand + 1 == frames) ? 0 : coldHand + 1;
+            if(hot[frame] || !Resident(frame)){
+                continue;
+            }
+            if(!Referenced(frame)){
+                return frame;
+            }
+            ClearReferenced(frame);
+            if(inTest[frame]){
+                Promote(frame);
+            } else {
+                inTest[frame] = 1;
+            }
+        }
+        while(true){
+            int frame = coldHand;
+            coldHand = (coldHand + 1 == frames) ? 0 : coldHand + 1;
+            if(Resident(frame)){
+                return frame;
+            }
+        }
+    }
+    void OnEvict(int frame) override {
+        if(!hot[frame] && inTest[frame]){
+            nonResident.PushBack(FramePageKey(frameBase + frame));
+        }
+        if(hot[frame]){
+            hotCount--;
+        }
+        hot[frame] = 0;
+        inTest[frame] = 0;
+    }
+    void OnInsert(int frame) override {
+        if(wasNonResident){
+            Promote(frame);
+        } else {
+            hot[frame] = 0;
+            inTest[frame] = 1;
+        }
+        wasNonResident = false;
+    }
+    void OnFree(int frame) override {
+        if(hot[frame]){
+            hotCount--;
+        }
+        hot[frame] = 0;
+        inTest[frame] = 0;
+    }
+};
+
+// ARC (adaptive replacement cache): T1 holds pages seen once recently and T2 pages seen at least
+// twice, with ghost lists B1 and B2 of their recent evictions steering the target size p of T1
+struct ArcPolicy : ReplacementPolicy {
+    FrameQueue t1;
+    FrameQueue t2;
+    GhostList b1;
+    GhostList b2;
+    std::vector<char> ghostTarget; // 1 or 2: the ghost list an evicted frame's key goes to, 0 for none
+    int frames;
+    int p;
+    int pendingList; // Ghost list the faulting page was found in, 0 if neither
+    bool dropT1;     // T1 plus B1 already fills the cache, so T1's oldest page leaves without a ghost
+
+    const char* Name() const override { return "arc"; }
+    void Reset(int count) override {
+        frames = count;
+        t1.Reset(count);
+        t2.Reset(count);
+        b1.Reset(count);
+        b2.Reset(count);
+        ghostTarget.assign(count, 0);
+        p = 0;
+        pendingList = 0;
+        dropT1 = false;
+    }
+    void SaveState(StateWriter* out) const override {
+        t1.Save(out);
+        t2.Save(out);
+        b1.Save(out);
+        b2.Save(out);
+        out->PutVector(ghostTarget);
+        out->Put(p);
+        out->Put(pendingList);
+        out->Put(dropT1);
+    }
+    bool LoadState(StateReader* in) override {
+        return t1.Load(in, frames) && t2.Load(in, frames) && b1.Load(in) && b2.Load(in) &&
+               in->GetVector(&ghostTarget, frames) && in->Get(&p) && in->Get(&pendingList) && in->Get(&dropT1);
+    }
+    void RenamePid(pid_t from, pid_t to) override {
+        b1.RenamePid(from, to);
+        b2.RenamePid(from, to);
+    }
+    void OnMiss(pid_t pid, int pageNumber) override {
+        uint64_t key = PageKey(pid, pageNumber);
+        dropT1 = false;
+        if(b1.Contains(key)){
+            int delta = (b1.size >= b2.size) ? 1 : b2.size / b1.size;
+            p = (p + delta < frames) ? p + delta : frames;
+            b1.Remove(key);
+            pendingList = 1;
+        } else if(b2.Contains(key)){
+            int delta = (b2.size >= b1.size) ? 1 : b1.size / b2.size;
+            p = (p - delta > 0) ? p - delta : 0;
+            b2.Remove(key);
+            pendingList = 2;
+        } else {
+            pendingList = 0;
+            int total = t1.size + t2.size + b1.size + b2.size;
+            if(t1.size + b1.size >= frames){
+                if(t1.size < frames){
+                    b1.PopFront();
+                } else {
+                    dropT1 = true;
+                }
+            } else if(total >= 2 * frames){
+                b2.PopFront();
+            }
+        }
+    }
+    int SelectVictim() override {
+        int frame;
+        if(dropT1 && t1.size > 0){
+            frame = t1.head;
+            ghostTarget[frame] = 0;
+        } else if(t1.size > 0 && (t1.size > p || (pendingList == 2 && t1.size == p) || t2.size == 0)){
+            frame = t1.head;
+            ghostTarget[frame] = 1;
+        } else {
+            frame = t2.head;
+            ghostTarget[frame] = 2;
+        }
+        return frame;
+    }
+    void OnEvict(int frame) override {
+        if(ghostTarget[frame] == 1){
+            b1.PushBack(FramePageKey(frameBase + frame));
+        } else if(ghostTarget[frame] == 2){
+            b2.PushBack(FramePageKey(frameBase + frame));
+        }
+        ghostTarget[frame] = 0;
+        t1.Remove(frame);
+        t2.Remove(frame);
+    }
+    void OnInsert(int frame) override {
+        if(pendingList != 0){
+            t2.PushBack(frame);
+        } else {
+            t1.PushBack(frame);
+        }
+        pendingList = 0;
+        dropT1 = false;
+    }
+    void OnHit(int frame) override {
+        t1.Remove(frame);
+        t2.Remove(frame);
+        t2.PushBack(frame);
+    }
+    void OnFree(int frame) override {
+        t1.Remove(frame);
+        t2.Remove(frame);
+    }
+};
+
+// Position in the reference stream of the next use of the page being referenced, set by the
+// caller before each reference when the future is known; OPT_NEVER if it is not used again
+#define OPT_NEVER UINT64_MAX
+inline uint64_t optNextUse = OPT_NEVER;
+
+// Belady's OPT: evicts the page whose next use is furthest in the future; only meaningful when the
+// whole reference stream is known ahead of time, as in trace replay
+struct OptPolicy : ReplacementPolicy {
+    std::vector<uint64_t> nextUse;
+    int frames;
+
+    const char* Name() const override { return "opt"; }
+    void Reset(int count) override {
+        frames = count;
+        nextUse.assign(count, OPT_NEVER);
+    }
+    void SaveState(StateWriter* out) const override { out->PutVector(nextUse); }
+    bool LoadState(StateReader* in) override { return in->GetVector(&nextUse, frames); }
+    int SelectVictim() override {
+        int victim = -1;
+        for(int frame = 0; frame < frames; frame++){
+            if(Resident(frame) && (victim == -1 || nextUse[frame] > nextUse[victim])){
+                victim = frame;
+                if(nextUse[victim] == OPT_NEVER){
+                    break;
+                }
+            }
+        }
+        return victim;
+    }
+    void OnInsert(int frame) override { nextUse[frame] = optNextUse; }
+    void OnHit(int frame) override { nextUse[frame] = optNextUse; }
+};
+
+// Names accepted by CreateReplacementPolicy, in the order replay -P all compares them
+inline const char* const REPLACEMENT_POLICY_NAMES[] = {"fifo", "clock", "nru", "aging", "wsclock", "clockpro", "arc", "opt"};
+
+// Builds the named policy; returns nullptr for an unknown name
+inline ReplacementPolicy* CreateReplacementPolicy(const char* name){
+    if(strcmp(name, "fifo") == 0) return new FifoPolicy();
+    if(strcmp(name, "clock") == 0) return new ClockPolicy();
+    if(strcmp(name, "nru") == 0) return new NruPolicy();
+    if(strcmp(name, "aging") == 0) return new AgingPolicy();
+    if(strcmp(name, "wsclock") == 0) return new WsClockPolicy();
+    if(strcmp(name, "clockpro") == 0) return new ClockProPolicy();
+    if(strcmp(name, "arc") == 0) return new ArcPolicy();
+    if(strcmp(name, "opt") == 0) return new OptPolicy();
+    return nullptr;
+}
+
+// Gives every frame table shard its own instance of the named policy; returns false for an unknown name
+inline bool SetReplacementPolicy(const char* name){
+    for(int s = 0; s < frameShardCount; s++){
+        ReplacementPolicy* policy = CreateReplacementPolicy(name);
+        if(policy == nullptr){
+            return false;
+        }
+        delete frameShards[s].policy;
+        frameShards[s].policy = policy;
+    }
+    return true;
+}
+
+#endif
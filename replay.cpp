@@ -0,0 +1,308 @@
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <iostream>
+#include <string>
+#include <string.h>
+#include <chrono>
+#include <unordered_map>
+#include <vector>
+#include "pager.h"
+#include "policy.h"
+#include "trace.h"
+#include "checkpoint.h"
+using namespace std;
+
+// Returns the slot replaying a pid, claiming a free one on its first reference; -1 if none are free
+int GetReplaySlot(pid_t pid){
+    static int lastSlot = 0;
+    if(processTable[lastSlot].isOccupied && processTable[lastSlot].pid == pid){
+        return lastSlot;
+    }
+    int freeSlot = -1;
+    for(int i = 0; i < processTableSize; i++){
+        if(processTable[i].isOccupied && processTable[i].pid == pid){
+            lastSlot = i;
+            return i;
+        }
+        if(!processTable[i].isOccupied && freeSlot == -1){
+            freeSlot = i;
+        }
+    }
+    if(freeSlot != -1){
+        processTable[freeSlot].isOccupied = 1;
+        processTable[freeSlot].pid = pid;
+        lastSlot = freeSlot;
+    }
+    return freeSlot;
+}
+
+// Computes, for every reference record, the index of the next record referencing the same page
+vector<uint64_t> ComputeNextUses(const Trace* trace){
+    uint64_t count = trace->header->recordCount;
+    vector<uint64_t> nextUse(count, OPT_NEVER);
+    unordered_map<uint64_t, uint64_t> laterUse;
+    for(uint64_t r = count; r-- > 0;){
+        const TraceRecord* record = &trace->records[r];
+        if(TraceRecordType(record) == TRACE_EXIT){
+            continue;
+        }
+        uint64_t key = PageKey(record->pid, PageNumber(TraceRecordAddress(record)));
+        auto found = laterUse.find(key);
+        if(found != laterUse.end()){
+            nextUse[r] = found->second;
+        }
+        laterUse[key] = r;
+    }
+    return nextUse;
+}
+
+// Replays the trace under one policy from an empty memory, or from the memory of a checkpoint; returns
+// false if the trace cannot fit
+bool ReplayTrace(const Trace* trace, const Checkpoint* warm, int passes, const vector<uint64_t>& nextUse, uint64_t* references, double* seconds){
+    for(int i = 0; i < processTableSize; i++){
+        processTable[i].isOccupied = 0;
+        processTable[i].pid = 0;
+        TlbFlush(i);
+    }
+    InitializePageTable(processTable);
+    if(warm != nullptr && !RestorePager(warm)){
+        std::cerr << "Error: the checkpoint is damaged or does not match the trace's page geometry" << std::endl;
+        return false;
+    }
+    memoryAccesses = 0;
+    pageFaults = 0;
+    pageWriteBacks = 0;
+    poolFaults = 0;
+    prefetchedPages = 0;
+    prefetchHits = 0;
+    prefetchWaste = 0;
+    sharedPageMappings = 0;
+    copyOnWriteFaults = 0;
+    copyOnWriteCopies = 0;
+    peakResidentFrames = 0;
+    tlbHits = 0;
+    tlbMisses = 0;
+    synchronousEvictions = 0;
+    backgroundWriteBacks = 0;
+
+    *references = 0;
+    std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+    for(int pass = 0; pass < passes; pass++){
+        for(uint64_t r = 0; r < trace->header->recordCount; r++){
+            const TraceRecord* record = &trace->records[r];
+            int slot = GetReplaySlot(record->pid);
+            if(slot == -1){
+                std::cerr << "Error: trace has more than " << processTableSize << " live processes" << std::endl;
+                return false;
+            }
+            int type = TraceRecordType(record);
+            if(type == TRACE_EXIT){
+                ReleaseProcessFrames(&processTable[slot]);
+                ResetSharedMappings(slot);
+                processTable[slot].isOccupied = 0;
+                processTable[slot].pid = 0;
+                continue;
+            }
+            if(!nextUse.empty()){
+                optNextUse = nextUse[r];
+            }
+            if(!HandlePageRequest(slot, TraceRecordAddress(record), (type == TRACE_WRITE) ? MSG_WRITE : MSG_READ) && ReclaimNeeded()){
+                // There is no clock here, so the reclaimer refills the pool as soon as it runs low
+                while(!ReclaimComplete() && ReclaimFrames(frameTableSize) > 0){
+                }
+            }
+            (*references)++;
+        }
+    }
+    std::chrono::duration<double> duration = std::chrono::high_resolution_clock::now() - start;
+    *seconds = duration.count();
+    return true;
+}
+
+// Drives the pager with every record of a trace, exactly as oss handled them but without IPC
+int main(int argc, char** argv){
+    int option;
+    string traceFileName = "";
+    string policyName = "clock";
+    string warmFileName = "";
+    int passes = 1;
+    while ( (option = getopt(argc, argv, "hf:p:P:w:g:L:a:k:")) != -1) {
+        switch(option) {
+            case 'h':
+                printf(" [-f traceFile] [-p passesOverTrace] [-P fifo|clock|nru|aging|wsclock|clockpro|arc|opt|all]\n"
+                       " [-w lowWatermark,highWatermark] [-g frames (page geometry comes from the trace)]\n"
+                       " [-L tlbEntries[,ways[,lru|fifo|random]]] [-a off|cluster[:pages]|readahead[:maxPages]]\n"
+                       " [-k checkpointFile (start from the memory oss saved with -c; its frame count replaces -g)]\n");
+                return 0;
+            case 'f':
+                traceFileName = optarg;
+                break;
+            case 'p':
+                passes = atoi(optarg);
+                if(passes < 1){
+                    std::cerr << "Error: replay needs at least one pass over the trace" << std::endl;
+                    return 1;
+                }
+                break;
+            case 'P':
+                policyName = optarg;
+                break;
+            case 'w':
+                freeHighWatermark = 0;
+                if(sscanf(optarg, "%d,%d", &freeLowWatermark, &freeHighWatermark) < 1 || freeHighWatermark < freeLowWatermark){
+                    freeHighWatermark = freeLowWatermark;
+                }
+                break;
+            case 'a':
+                if(!ParsePrefetch(optarg)){
+                    std::cerr << "Error: prepaging must be off, cluster[:pages] or readahead[:maxPages]" << std::endl;
+                    return 1;
+                }
+                break;
+            case 'L':
+                if(!ParseTlb(optarg)){
+                    std::cerr << "Error: TLB must be entries[,ways[,lru|fifo|random]] with ways dividing entries" << std::endl;
+                    return 1;
+                }
+                break;
+            case 'k':
+                warmFileName = optarg;
+                break;
+            case 'g':
+                frameTableSize = atoi(optarg);
+                if(frameTableSize < 1){
+                    std::cerr << "Error: the frame table needs at least one frame" << std::endl;
+                    return 1;
+                }
+                break;
+        }
+    }
+    if(freeLowWatermark < 0 || freeHighWatermark > frameTableSize){
+        std::cerr << "Error: watermarks must be between 0 and " << frameTableSize << std::endl;
+        return 1;
+    }
+    if(traceFileName.empty()){
+        std::cerr << "Error: a trace file is required (-f)" << std::endl;
+        return 1;
+    }
+
+    vector<string> policies;
+    if(policyName == "all"){
+        for(const char* name : REPLACEMENT_POLICY_NAMES){
+            // OPT only knows the next use of the page being referenced, not of pages prepaged with it
+            if(prefetchMode == PREFETCH_OFF || strcmp(name, "opt") != 0){
+                policies.push_back(name);
+            }
+        }
+    } else {
+        if(policyName == "opt" && prefetchMode != PREFETCH_OFF){
+            std::cerr << "Error: opt cannot be combined with prepaging" << std::endl;
+            return 1;
+        }
+        ReplacementPolicy* check = CreateReplacementPolicy(policyName.c_str());
+        if(check == nullptr){
+            std::cerr << "Error: unknown replacement policy " << policyName << std::endl;
+            return 1;
+        }
+        delete check;
+        policies.push_back(policyName);
+    }
+
+    Trace trace;
+    if(!TraceOpenReader(&trace, traceFileName.c_str())){
+        std::cerr << "Error: unable to map trace " << traceFileName << std::endl;
+        return 1;
+    }
+
+    if(!SetPageGeometry(trace.header->pageSize, trace.header->pagesPerProcess) || !SetSharedPages(trace.header->sharedPages)){
+        std::cerr << "Error: trace " << traceFileName << " has an invalid page geometry" << std::endl;
+        return 1;
+    }
+
+    // A warm start keeps the checkpoint's processes in their slots, with room for the trace's beside them
+    Checkpoint warm;
+    int slots = TOTAL_INSTANCES;
+    if(!warmFileName.empty()){
+        if(!CheckpointOpen(&warm, warmFileName.c_str())){
+            std::cerr << "Error: " << warmFileName << " is not a checkpoint" << std::endl;
+            return 1;
+        }
+        if(warm.header->pageSize != pageSize || warm.header->pagesPerProcess != pagesPerProcess || warm.header->sharedPages != sharedPages
+           || warm.header->shards != 1){
+            std::cerr << "Error: checkpoint " << warmFileName << " has another page geometry than the trace" << std::endl;
+            return 1;
+        }
+        frameTableSize = warm.header->frames;
+        slots += warm.header->slots;
+        if(freeLowWatermark < 0 || freeHighWatermark > frameTableSize){
+            std::cerr << "Error: watermarks must be between 0 and " << frameTableSize << std::endl;
+            return 1;
+        }
+    }
+
+    if(!PrefetchFitsShards()){
+        std::cerr << "Error: prepaging must cover fewer pages than the " << frameTableSize << " frames" << std::endl;
+        return 1;
+    }
+
+    // The pager's tables live in ordinary memory here instead of a shared segment
+    AllocateProcessTable(slots);
+    AllocateTlbs(slots);
+    void* memorySegment = calloc(1, MemorySegmentSize(slots));
+    LayoutMemorySegment(memorySegment);
+
+    printf("Replay of %s (%llu records, %d pass%s, %d frames of %d bytes)\n", traceFileName.c_str(), (unsigned long long)trace.header->recordCount,
+           passes, passes == 1 ? "" : "es", frameTableSize, pageSize);
+    if(!warmFileName.empty()){
+        printf("Warm start from %s (%d of %d frames resident, saved under %s)\n", warmFileName.c_str(),
+               CheckpointResidentFrames(&warm), warm.header->frames, warm.header->policy);
+    }
+    if(policies.size() > 1){
+        printf("%-10s %12s %10s %12s %16s\n", "policy", "faults", "fault-rate", "write-backs", "accesses/sec");
+    }
+    for(const string& name : policies){
+        SetReplacementPolicy(name.c_str());
+        // Only OPT needs the future, and computing it costs a pass over the trace
+        vector<uint64_t> nextUse;
+        if(name == "opt"){
+            nextUse = ComputeNextUses(&trace);
+        }
+
+        uint64_t references;
+        double seconds;
+        if(!ReplayTrace(&trace, warmFileName.empty() ? nullptr : &warm, passes, nextUse, &references, &seconds)){
+            return 1;
+        }
+        double faultRate = references ? (double)pageFaults / references : 0.0;
+        if(policies.size() > 1){
+            printf("%-10s %12lld %10.4f %12lld %16.1f\n", name.c_str(), pageFaults.load(), faultRate, pageWriteBacks.load(), references / seconds);
+        } else {
+            printf("Replacement Policy: %s\n", frameShards[0].policy->Name());
+            printf("Number of Faults: %lld\n", pageFaults.load());
+            printf("Number of Memory Accesses: %llu\n", (unsigned long long)references);
+            printf("Faults per Memory Access: %.4f\n", faultRate);
+            printf("Number of Dirty Page Write-backs: %lld\n", pageWriteBacks.load());
+            printf("Peak Resident Frames: %d of %d\n", peakResidentFrames.load(), frameTableSize);
+            if(prefetchMode != PREFETCH_OFF){
+                printf("Prepaged Pages: %d (%d hits, %d wasted)\n", prefetchedPages.load(), prefetchHits.load(), prefetchWaste.load());
+            }
+            if(sharedPages > 0){
+                printf("Shared Image: %d pages; %d mapped without a page-in, %d copy-on-write faults (%d copied)\n", sharedPages,
+                       sharedPageMappings.load(), copyOnWriteFaults.load(), copyOnWriteCopies.load());
+            }
+            if(tlbEntries > 0){
+                long long tlbLookups = tlbHits + tlbMisses;
+                printf("TLB Hit Rate: %.4f (%d entries, %d-way, %s)\n", tlbLookups ? (double)tlbHits / tlbLookups : 0.0, tlbEntries, tlbWays, TlbReplacementName());
+            }
+            printf("Memory Accesses per second: %.1f\n", references / seconds);
+        }
+    }
+
+    TraceCloseReader(&trace);
+    if(!warmFileName.empty()){
+        CheckpointClose(&warm);
+    }
+    free(memorySegment);
+    return 0;
+}
@@ -0,0 +1,178 @@
+// Simulated per-process TLB consulted before the page table (oss -L, replay -L): each process table slot
+// has its own set-associative cache of page-to-frame translations, with LRU, FIFO or random replacement.
+// The pager inserts a translation when a reference walks the page table or faults a page in and
+// invalidates it when the page's frame is unmapped, so a TLB hit always names the resident frame
+#ifndef TLB_H
+#define TLB_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <atomic>
+#include <mutex>
+
+#define TLB_LRU 0
+#define TLB_FIFO 1
+#define TLB_RANDOM 2
+#define TLB_LOOKUP_TIME 1 // Simulated ns charged for consulting the TLB
+
+// Geometry and replacement, set with -L; no entries disables the TLB
+inline int tlbEntries = 0;
+inline int tlbWays = 0;
+inline int tlbSets = 0;
+inline int tlbReplacement = TLB_LRU;
+
+// Structures for one slot's TLB: entries are grouped by set, tlbWays to a set
+struct Tlb {
+    int32_t* pages;   // Virtual page of each entry, -1 when invalid
+    int32_t* frames;
+    uint32_t* stamps; // LRU: last use; FIFO: insertion
+    uint32_t clock;   // Ticks on every stamp
+    uint64_t random;  // xorshift state for random replacement
+    std::mutex lock;
+};
+
+inline Tlb* tlbs = nullptr;
+inline bool tlbLocking = false; // Set once more than one thread uses the tables
+inline std::atomic<long long> tlbHits{0};
+inline std::atomic<long long> tlbMisses{0};
+
+inline const char* TlbReplacementName(){
+    return (tlbReplacement == TLB_FIFO) ? "fifo" : (tlbReplacement == TLB_RANDOM) ? "random" : "lru";
+}
+
+// Parses entries[,ways[,lru|fifo|random]]; the ways default to the entries (fully associative) and must
+// divide them. Returns false, changing nothing, if it is not valid
+inline bool ParseTlb(const char* arg){
+    int entries = 0, ways = 0;
+    char replacement[16] = "lru";
+    if(sscanf(arg, "%d,%d,%15s", &entries, &ways, replacement) < 1 || entries < 0){
+        return false;
+    }
+    if(ways <= 0 || ways > entries){
+        ways = entries;
+    }
+    int policy;
+    if(strcmp(replacement, "lru") == 0){
+        policy = TLB_LRU;
+    } else if(strcmp(replacement, "fifo") == 0){
+        policy = TLB_FIFO;
+    } else if(strcmp(replacement, "random") == 0){
+        policy = TLB_RANDOM;
+    } else {
+        return false;
+    }
+    if(entries > 0 && entries % ways != 0){
+        return false;
+    }
+    tlbEntries = entries;
+    tlbWays = ways;
+    tlbSets = (ways > 0) ? entries / ways : 0;
+    tlbReplacement = policy;
+    return true;
+}
+
+// Empties a slot's TLB, as when a new process is placed in the slot
+inline void TlbFlush(int slot){
+    if(tlbEntries == 0){
+        return;
+    }
+    Tlb* tlb = &tlbs[slot];
+    for(int e = 0; e < tlbEntries; e++){
+        tlb->pages[e] = -1;
+        tlb->stamps[e] = 0;
+    }
+    tlb->clock = 0;
+}
+
+// Allocates an empty TLB for every process table slot
+inline void AllocateTlbs(int slots){
+    if(tlbEntries == 0){
+        return;
+    }
+    tlbs = new Tlb[slots];
+    for(int i = 0; i < slots; i++){
+        tlbs[i].pages = new int32_t[tlbEntries];
+        tlbs[i].frames = new int32_t[tlbEntries];
+        tlbs[i].stamps = new uint32_t[tlbEntries];
+        tlbs[i].random = 0x9E3779B97F4A7C15ull ^ (uint64_t)(i + 1);
+        TlbFlush(i);
+    }
+}
+
+// Holds a slot's TLB lock for the rest of a scope when the tables are shared between threads
+struct TlbGuard {
+    Tlb* tlb;
+    explicit TlbGuard(Tlb* held) : tlb(tlbLocking ? held : nullptr) {
+        if(tlb != nullptr){
+            tlb->lock.lock();
+        }
+    }
+    ~TlbGuard(){
+        if(tlb != nullptr){
+            tlb->lock.unlock();
+        }
+    }
+};
+
+// Returns the frame a slot's TLB holds for a page, counting the hit or miss; -1 on a miss
+inline int TlbLookup(int slot, int pageNumber){
+    Tlb* tlb = &tlbs[slot];
+    TlbGuard guard(tlb);
+    int base = (pageNumber % tlbSets) * tlbWays;
+    for(int e = base; e < base + tlbWays; e++){
+        if(tlb->pages[e] == pageNumber){
+            if(tlbReplacement == TLB_LRU){
+                tlb->stamps[e] = ++tlb->clock;
+            }
+            tlbHits++;
+            return tlb->frames[e];
+        }
+    }
+    tlbMisses++;
+    return -1;
+}
+
+// Caches a page's translation in a slot's TLB, replacing an invalid entry of its set if there is one
+inline void TlbInsert(int slot, int pageNumber, int frame){
+    Tlb* tlb = &tlbs[slot];
+    TlbGuard guard(tlb);
+    int base = (pageNumber % tlbSets) * tlbWays;
+    int victim = -1;
+    for(int e = base; e < base + tlbWays && victim == -1; e++){
+        if(tlb->pages[e] == -1){
+            victim = e;
+        }
+    }
+    if(victim == -1 && tlbReplacement == TLB_RANDOM){
+        tlb->random ^= tlb->random << 13;
+        tlb->random ^= tlb->random >> 7;
+        tlb->random ^= tlb->random << 17;
+        victim = base + (int)(tlb->random % tlbWays);
+    } else if(victim == -1){
+        victim = base;
+        for(int e = base + 1; e < base + tlbWays; e++){
+            if(tlb->stamps[e] < tlb->stamps[victim]){
+                victim = e;
+            }
+        }
+    }
+    tlb->pages[victim] = pageNumber;
+    tlb->frames[victim] = frame;
+    tlb->stamps[victim] = ++tlb->clock;
+}
+
+// Drops a page's translation from a slot's TLB, if it is cached
+inline void TlbInvalidate(int slot, int pageNumber){
+    Tlb* tlb = &tlbs[slot];
+    TlbGuard guard(tlb);
+    int base = (pageNumber % tlbSets) * tlbWays;
+    for(int e = base; e < base + tlbWays; e++){
+        if(tlb->pages[e] == pageNumber){
+            tlb->pages[e] = -1;
+            return;
+        }
+    }
+}
+
+#endif
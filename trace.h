@@ -0,0 +1,173 @@
+// Compact binary reference traces: oss -r records every reference it handles through an mmap'd,
+// append-only file, and replay memory-maps the file to drive the pager without any child processes
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdint.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#define TRACE_MAGIC "OSSTRACE"
+#define TRACE_VERSION 3 // Version 2 added the page geometry to the header, version 3 the shared image
+#define TRACE_GROW_RECORDS (1 << 20) // Records added each time the file has to grow
+
+// Record types, stored in the top two bits of addressAndType
+#define TRACE_READ 0
+#define TRACE_WRITE 1
+#define TRACE_EXIT 2   // The process terminated; its frames are released
+#define TRACE_TYPE_SHIFT 30
+#define TRACE_ADDRESS_MASK ((1u << TRACE_TYPE_SHIFT) - 1)
+
+// Structures for the trace file header
+struct TraceHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t recordSize;
+    uint64_t recordCount;
+    uint32_t pageSize;        // Page geometry oss ran with, so replay splits addresses into the same pages
+    uint32_t pagesPerProcess;
+    uint32_t sharedPages;     // Pages of every address space that map the shared image (oss -H)
+    uint32_t reserved;
+};
+
+// Structures for one 16-byte trace record
+struct TraceRecord {
+    uint64_t time;           // Simulated nanoseconds when oss handled the reference
+    int32_t pid;
+    uint32_t addressAndType;
+};
+
+// Structures for an open trace, either being written or mapped for replay
+struct Trace {
+    int fd;
+    void* map;
+    size_t mapSize;
+    TraceHeader* header;
+    TraceRecord* records;
+    uint64_t capacity;
+};
+
+inline int TraceRecordType(const TraceRecord* record){
+    return (int)(record->addressAndType >> TRACE_TYPE_SHIFT);
+}
+
+inline int TraceRecordAddress(const TraceRecord* record){
+    return (int)(record->addressAndType & TRACE_ADDRESS_MASK);
+}
+
+// Sizes the file for the given number of records and maps it; returns false on failure
+inline bool TraceMapForWriting(Trace* trace, uint64_t capacity){
+    size_t size = sizeof(TraceHeader) + capacity * sizeof(TraceRecord);
+    if(ftruncate(trace->fd, size) == -1){
+        return false;
+    }
+    void* map = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, trace->fd, 0);
+    if(map == MAP_FAILED){
+        return false;
+    }
+    trace->map = map;
+    trace->mapSize = size;
+    trace->header = (TraceHeader*)map;
+    trace->records = (TraceRecord*)((char*)map + sizeof(TraceHeader));
+    trace->capacity = capacity;
+    return true;
+}
+
+// Creates a trace file for recording references made under the given page geometry and shared image;
+// returns false if it cannot be created
+inline bool TraceOpenWriter(Trace* trace, const char* path, int pageSize, int pagesPerProcess, int sharedPages){
+    trace->fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if(trace->fd == -1 || !TraceMapForWriting(trace, TRACE_GROW_RECORDS)){
+        return false;
+    }
+    memcpy(trace->header->magic, TRACE_MAGIC, sizeof(trace->header->magic));
+    trace->header->version = TRACE_VERSION;
+    trace->header->recordSize = sizeof(TraceRecord);
+    trace->header->recordCount = 0;
+    trace->header->pageSize = pageSize;
+    trace->header->pagesPerProcess = pagesPerProcess;
+    trace->header->sharedPages = sharedPages;
+    trace->header->reserved = 0;
+    return true;
+}
+
+// Appends one record, growing and remapping the file when it is full; returns false, recording nothing
+// from then on, if the file could not grow
+inline bool TraceAppend(Trace* trace, pid_t pid, int memoryAddress, int type, uint64_t time){
+    if(trace->map == nullptr){
+        return false;
+    }
+    uint64_t count = trace->header->recordCount;
+    if(count == trace->capacity){
+        munmap(trace->map, trace->mapSize);
+        if(!TraceMapForWriting(trace, trace->capacity + TRACE_GROW_RECORDS)){
+            ftruncate(trace->fd, sizeof(TraceHeader) + count * sizeof(TraceRecord));
+            trace->map = nullptr;
+            trace->header = nullptr;
+            trace->records = nullptr;
+            return false;
+        }
+    }
+    TraceRecord* record = &trace->records[count];
+    record->time = time;
+    record->pid = pid;
+    record->addressAndType = ((uint32_t)type << TRACE_TYPE_SHIFT) | ((uint32_t)memoryAddress & TRACE_ADDRESS_MASK);
+    trace->header->recordCount = count + 1;
+    return true;
+}
+
+// Unmaps a trace being recorded and trims the file to the records actually written
+inline void TraceCloseWriter(Trace* trace){
+    if(trace->map == nullptr){
+        close(trace->fd);
+        return;
+    }
+    uint64_t count = trace->header->recordCount;
+    munmap(trace->map, trace->mapSize);
+    ftruncate(trace->fd, sizeof(TraceHeader) + count * sizeof(TraceRecord));
+    close(trace->fd);
+    trace->map = nullptr;
+}
+
+// Maps an existing trace read-only; returns false if it is missing, not a trace or from another version
+inline bool TraceOpenReader(Trace* trace, const char* path){
+    trace->fd = open(path, O_RDONLY);
+    if(trace->fd == -1){
+        return false;
+    }
+    struct stat st;
+    if(fstat(trace->fd, &st) == -1 || (size_t)st.st_size < sizeof(TraceHeader)){
+        close(trace->fd);
+        return false;
+    }
+    void* map = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE | MAP_POPULATE, trace->fd, 0);
+    if(map == MAP_FAILED){
+        close(trace->fd);
+        return false;
+    }
+    trace->map = map;
+    trace->mapSize = st.st_size;
+    trace->header = (TraceHeader*)map;
+    trace->records = (TraceRecord*)((char*)map + sizeof(TraceHeader));
+    trace->capacity = (st.st_size - sizeof(TraceHeader)) / sizeof(TraceRecord);
+    if(memcmp(trace->header->magic, TRACE_MAGIC, sizeof(trace->header->magic)) != 0
+       || trace->header->version != TRACE_VERSION || trace->header->recordSize != sizeof(TraceRecord) || trace->header->recordCount > trace->capacity){
+        munmap(map, st.st_size);
+        close(trace->fd);
+        return false;
+    }
+    madvise(map, st.st_size, MADV_SEQUENTIAL);
+    return true;
+}
+
+// Unmaps a trace opened for replay
+inline void TraceCloseReader(Trace* trace){
+    munmap(trace->map, trace->mapSize);
+    close(trace->fd);
+}
+
+#endif
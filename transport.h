@@ -0,0 +1,168 @@
+// Message protocol and transports shared by oss and user
+#ifndef TRANSPORT_H
+#define TRANSPORT_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#include <atomic>
+
+// Message codes
+#define MSG_READ 1
+#define MSG_WRITE 2
+#define MSG_BLOCKED 3
+#define MSG_GRANTED 4
+#define MSG_BATCH 5
+#define MAX_BATCH_SIZE 64
+
+// Transports selectable with oss -T
+#define TRANSPORT_MSGQ 0
+#define TRANSPORT_RING 1
+#define RING_CAPACITY 4         // Each child has at most one request outstanding
+#define RING_SPIN_ITERATIONS 256 // Polls before a consumer sleeps on the futex
+#define RING_PROJ_ID 37
+#define DOORBELL_PROJ_ID 38
+
+// Structures for a single memory reference inside a batch
+typedef struct MemoryReference {
+        int memoryAddress;
+        int msgCode; // MSG_READ or MSG_WRITE
+} MemoryReference;
+
+// Structures for Message Buffer
+// Requests carry count references; replies carry how many were granted and which one blocked
+typedef struct MessageBuffer {
+        long mtype;
+        int msgCode;
+        int memoryAddress;
+        pid_t sender;
+        int count;
+        int blockedIndex; // -1 when every granted reference was a hit
+        MemoryReference references[MAX_BATCH_SIZE];
+} MessageBuffer;
+
+// Size of the message payload (everything after mtype) holding the given number of references
+#define MESSAGE_SIZE(n) (offsetof(MessageBuffer, references) - sizeof(long) + (n) * sizeof(MemoryReference))
+
+// Single-producer/single-consumer ring of messages in shared memory
+// head is advanced by the consumer, tail by the producer; both count up and wrap modulo 2^32
+struct MessageRing {
+    alignas(64) std::atomic<uint32_t> head;
+    alignas(64) std::atomic<uint32_t> tail;
+    std::atomic<uint32_t> consumerWaiting; // Set while the consumer sleeps on tail
+    std::atomic<uint32_t> producerWaiting; // Set while the producer sleeps on head
+    alignas(64) MessageBuffer slots[RING_CAPACITY];
+};
+
+// Structures for a process table slot's pair of rings
+struct ChannelPair {
+    MessageRing request;                // child -> oss
+    MessageRing reply;                  // oss -> child
+    std::atomic<long long> childSyscalls; // futex calls made by the child, for the final report
+};
+
+// Structures for the doorbell children ring to wake oss from its event wait
+struct Doorbell {
+    std::atomic<uint32_t> ossWaiting; // Set by oss just before it blocks in epoll_wait
+    std::atomic<long long> wakeups;   // eventfd writes made by children, for the final report
+};
+
+// Wakes oss through its eventfd if it is, or is about to be, asleep; call after publishing a request
+inline void RingDoorbell(Doorbell* doorbell, int wakeFd){
+    if(doorbell->ossWaiting.load()){
+        uint64_t one = 1;
+        if(write(wakeFd, &one, sizeof(one)) == sizeof(one)){
+            doorbell->wakeups.fetch_add(1);
+        }
+    }
+}
+
+// Sleeps while *word still holds expected; returns immediately if it has already changed
+inline void FutexWait(std::atomic<uint32_t>* word, uint32_t expected){
+    syscall(SYS_futex, reinterpret_cast<uint32_t*>(word), FUTEX_WAIT, expected, nullptr, nullptr, 0);
+}
+
+// Wakes every waiter sleeping on word
+inline void FutexWake(std::atomic<uint32_t>* word){
+    syscall(SYS_futex, reinterpret_cast<uint32_t*>(word), FUTEX_WAKE, INT32_MAX, nullptr, nullptr, 0);
+}
+
+// Empties a ring; only safe while neither end is in use
+inline void ResetRing(MessageRing* ring){
+    ring->head.store(0);
+    ring->tail.store(0);
+    ring->consumerWaiting.store(0);
+    ring->producerWaiting.store(0);
+}
+
+// Spins and then sleeps until value no longer equals the word's contents; returns futex calls made
+inline int WaitWhileEqual(std::atomic<uint32_t>* word, std::atomic<uint32_t>* waitingFlag, uint32_t value){
+    for(int i = 0; i < RING_SPIN_ITERATIONS; i++){
+        if(word->load(std::memory_order_acquire) != value){
+            return 0;
+        }
+    }
+    int syscalls = 0;
+    while(word->load(std::memory_order_acquire) == value){
+        waitingFlag->store(1);
+        if(word->load() == value){
+            FutexWait(word, value);
+            syscalls++;
+        }
+        waitingFlag->store(0);
+    }
+    return syscalls;
+}
+
+// Copies the first size bytes after mtype of msg into the ring and wakes the consumer if it sleeps
+// The consumer only sleeps on an empty ring, so a wake-up happens only on the empty -> non-empty edge
+// Returns the number of futex calls made
+inline int RingPush(MessageRing* ring, const MessageBuffer* msg, size_t size){
+    int syscalls = 0;
+    uint32_t tail = ring->tail.load(std::memory_order_relaxed);
+    uint32_t head = ring->head.load(std::memory_order_acquire);
+    while(tail - head == RING_CAPACITY){
+        syscalls += WaitWhileEqual(&ring->head, &ring->producerWaiting, head);
+        head = ring->head.load(std::memory_order_acquire);
+    }
+    MessageBuffer* slot = &ring->slots[tail % RING_CAPACITY];
+    slot->mtype = msg->mtype;
+    memcpy(reinterpret_cast<char*>(slot) + sizeof(long), reinterpret_cast<const char*>(msg) + sizeof(long), size);
+    ring->tail.store(tail + 1);
+    if(ring->consumerWaiting.load()){
+        FutexWake(&ring->tail);
+        syscalls++;
+    }
+    return syscalls;
+}
+
+// Pops the oldest message into out if one is available; returns false on an empty ring
+inline bool RingTryPop(MessageRing* ring, MessageBuffer* out, int* syscalls){
+    uint32_t head = ring->head.load(std::memory_order_relaxed);
+    if(ring->tail.load(std::memory_order_acquire) == head){
+        return false;
+    }
+    *out = ring->slots[head % RING_CAPACITY];
+    ring->head.store(head + 1);
+    if(ring->producerWaiting.load()){
+        FutexWake(&ring->head);
+        (*syscalls)++;
+    }
+    return true;
+}
+
+// Pops the oldest message into out, sleeping on the futex while the ring is empty
+inline int RingPop(MessageRing* ring, MessageBuffer* out){
+    int syscalls = 0;
+    while(!RingTryPop(ring, out, &syscalls)){
+        syscalls += WaitWhileEqual(&ring->tail, &ring->consumerWaiting, ring->head.load(std::memory_order_relaxed));
+    }
+    return syscalls;
+}
+
+#endif
@@ -16,32 +16,21 @@
 #include <sys/msg.h>
 #include <sys/mman.h>
 #include <errno.h>
-#include <random>
 #include <chrono>
+#include "transport.h"
+#include "workload.h"
+#include "control.h"
 using namespace std;
 
 // Constants for simulation behavior
-#define TERMINATION_CHANCE 1  // 0.1% chance to terminate every loop
-#define READ_CHANCE 85        // 85% chance to read, 15% chance to write
-#define DISPATCH_AMOUNT 1e7
 #define CHILD_LAUNCH_AMOUNT 1000
 #define UNBLOCK_AMOUNT 1000
 #define MSGQ_FILE_PATH "msgq.txt"
 #define MSGQ_PROJ_ID 65
 #define PERMS 0644
-#define MSG_GRANTED 4
-#define MSG_BLOCKED 3
-#define MSG_WRITE 2
-#define MSG_READ 1
 #define TOTAL_RESOURCES 10
 #define TOTAL_INSTANCES 20
 
-// System clock structure
-typedef struct SystemClock {
-    int seconds;
-    int nanosecond;
-} SystemClock;
-
 // Process Control Block structure
 struct ProcessControlBlock {
     int isOccupied;
@@ -52,32 +41,6 @@ struct ProcessControlBlock {
     int resourcesHeld[TOTAL_RESOURCES];
 };
 
-// Message buffer structure
-typedef struct MessageBuffer {
-        long mtype;
-        int msgCode;
-        int memoryAddress;
-        pid_t sender;
-} MessageBuffer;
-
-// Function to increment the system clock
-void IncrementClock(SystemClock* c, int increment_amount){
-    c->nanosecond = c->nanosecond + increment_amount;
-    if (c->nanosecond >= 1e9){
-        c->nanosecond -= 1e9;
-        c->seconds++;
-    }
-}
-
-// Function to add time to a given time
-void timeAddition(int *addend1Secs, int *addend1Nanos, int addend2Nanos){
-    *addend1Nanos += addend2Nanos;
-    if (*addend1Nanos >= 1e9){
-        *addend1Nanos -= 1e9;
-        *addend1Secs++;
-    }
-}
-
 
 void InitializeProcessTable(ProcessControlBlock processTable[]){
     for(int i = 0; i < 20; i++){
@@ -210,21 +173,18 @@ int GetProcessIndex(ProcessControlBlock processTable[], int maxSimultaneousProce
     return -1;
 }
 
-// Utility function to generate a random number
-int GenerateRandomNumber(int min, int max, int pid) {
-    unsigned seed = std::chrono::system_clock::now().time_since_epoch().count() * pid;
-    std::default_random_engine generator(seed);
-    std::uniform_int_distribution<int> distribution(min, max);
-    int random_number = distribution(generator);
-    return random_number;
-}
-
 // Main function simulating a user process
 int main(int argc, char** argv) {
-    SystemClock* shm_clock;
-        key_t clock_key = ftok("/tmp", 35);
-        int shmtid = shmget(clock_key, sizeof(SystemClock), 0666);
-        shm_clock = (SystemClock*)shmat(shmtid, NULL, 0);
+    // Attach to the control segment holding the clock and this slot's counters
+    int slot = (argc > 3) ? atoi(argv[3]) : 0;
+    key_t control_key = ftok("/tmp", CONTROL_PROJ_ID);
+    int shmtid = shmget(control_key, 0, 0666); // Sized by oss for its -s slots
+    if(shmtid == -1){
+        perror("shmget for the control segment in child");
+        exit(1);
+    }
+    ControlSegment* control = (ControlSegment*)shmat(shmtid, NULL, 0);
+    SlotStats* stats = ControlSlotStats(control, slot);
 
         int msgqid = 0;
         key_t msgq_key;
@@ -236,51 +196,120 @@ int main(int argc, char** argv) {
                 perror("msgget in child");
                 exit(1);
         }
+    bool quiet = (argc > 5 && strcmp(argv[5], "q") == 0); // oss is running with -q
+    if(!quiet){
         printf("%d: Child has access to the msg queue\n",getpid());
-    printf("USER PID: %d  PPID: %d  SysClockS: %d  SysClockNano: %d \n--Just Starting\n", getpid(), getppid(), shm_clock->seconds, shm_clock->nanosecond);
-
+        long long now = (long long)ClockRead(&control->clock);
+        printf("USER PID: %d  PPID: %d  SysClockS: %d  SysClockNano: %d \n--Just Starting\n", getpid(), getppid(), TimeSeconds(now), TimeNanoseconds(now));
+    }
 
-    MessageBuffer buf, rcvbuf;
-    buf.mtype = getppid();
-    buf.sender = getpid();
 
+    int batchSize = (argc > 1) ? atoi(argv[1]) : 1;
+    if(batchSize < 1 || batchSize > MAX_BATCH_SIZE){
+        batchSize = 1;
+    }
 
-    while(true){
-        if (TERMINATION_CHANCE > GenerateRandomNumber(0, 1000, getpid())){
-            std::cout << "Child " << getpid() << " randomly terminating..." << std::endl;
-            break;
+    // Attach to the doorbell used to wake oss when it is waiting for events
+    int wakeFd = (argc > 4) ? atoi(argv[4]) : -1;
+    key_t doorbell_key = ftok("/tmp", DOORBELL_PROJ_ID);
+    int shmdid = shmget(doorbell_key, sizeof(Doorbell), 0666);
+    if(shmdid == -1){
+        perror("shmget for doorbell in child");
+        exit(1);
+    }
+    Doorbell* doorbell = (Doorbell*)shmat(shmdid, NULL, 0);
+
+    // Attach to this slot's ring pair when oss selected the ring transport
+    int transport = (argc > 2 && strcmp(argv[2], "ring") == 0) ? TRANSPORT_RING : TRANSPORT_MSGQ;
+    ChannelPair* channels = nullptr;
+    ChannelPair* channel = nullptr;
+    if(transport == TRANSPORT_RING){
+        key_t ring_key = ftok("/tmp", RING_PROJ_ID);
+        int shmrid = shmget(ring_key, 0, 0666); // Sized by oss for its -s slots
+        if(shmrid == -1){
+            perror("shmget for rings in child");
+            exit(1);
         }
+        channels = (ChannelPair*)shmat(shmrid, NULL, 0);
+        channel = &channels[slot];
+    }
 
-        int pageNumber = GenerateRandomNumber(0, 63, getpid());
-        int offset = GenerateRandomNumber(0, 1023, getpid());
-        buf.memoryAddress = (pageNumber * 1024) + offset;
+    // Page geometry oss was started with (-g)
+    int pageSize = (argc > 6) ? atoi(argv[6]) : 1024;
+    int pages = (argc > 7) ? atoi(argv[7]) : 64;
 
-        if(READ_CHANCE > GenerateRandomNumber(1, 100, getpid())){
-            buf.msgCode = MSG_READ;
-        } else {
-            buf.msgCode = MSG_WRITE;
-        }
-        if(msgsnd(msgqid, &buf, sizeof(MessageBuffer), 1) == -1) {
-            perror("msgsnd to parent failed\n");
-            exit(1);
+    // Workload and generator seed oss chose for this user (-W, -R, -S)
+    WorkloadSpec workload;
+    if(!ParseWorkload((argc > 8) ? argv[8] : DEFAULT_WORKLOAD, &workload)){
+        ParseWorkload(DEFAULT_WORKLOAD, &workload);
+    }
+    int readPercent = (argc > 9) ? atoi(argv[9]) : READ_CHANCE;
+    uint64_t seed = (argc > 10) ? strtoull(argv[10], nullptr, 10) : (uint64_t)getpid();
+
+    MessageBuffer buf, rcvbuf;
+    UserState user;
+    InitializeUser(&user, &buf, getpid(), getppid(), pageSize, pages, &workload, readPercent, seed);
+
+    // Relaunched from a checkpoint (oss -k): pick up where the user this one replaces left off, waiting
+    // first for the reply to a batch it had sent
+    bool replyPending = false;
+    bool counted = false;
+    if(argc > 11 && strcmp(argv[11], "resume") == 0){
+        SlotResume* resume = ControlSlotResume(control, slot);
+        SkipReferences(&user, resume->generated);
+        buf.count = resume->batch.count;
+        memcpy(buf.references, resume->batch.references, buf.count * sizeof(MemoryReference));
+        replyPending = resume->outstanding;
+        counted = resume->counted;
+    }
+    std::chrono::steady_clock::time_point sentAt = std::chrono::steady_clock::now();
+
+    while(replyPending || !user.terminating || buf.count > 0){
+        if(!replyPending){
+            int carried = buf.count;
+            if(FillBatch(&user, &buf, batchSize) && !quiet){
+                std::cout << "Child " << getpid() << " randomly terminating..." << std::endl;
+            }
+            if(buf.count == 0){
+                break;
+            }
+            if(!counted){
+                NoteBatchSent(stats, &buf, carried);
+            }
+            counted = false;
+            sentAt = std::chrono::steady_clock::now();
+
+            if(transport == TRANSPORT_RING){
+                channel->childSyscalls.fetch_add(RingPush(&channel->request, &buf, MESSAGE_SIZE(buf.count)));
+            } else if(msgsnd(msgqid, &buf, MESSAGE_SIZE(buf.count), 0) == -1) {
+                perror("msgsnd to parent failed\n");
+                exit(1);
+            }
+            RingDoorbell(doorbell, wakeFd);
         }
+        replyPending = false;
 
-        if(msgrcv(msgqid, &rcvbuf, sizeof(MessageBuffer), getpid(), 0) == -1) {
+        if(transport == TRANSPORT_RING){
+            channel->childSyscalls.fetch_add(RingPop(&channel->reply, &rcvbuf));
+        } else if(msgrcv(msgqid, &rcvbuf, MESSAGE_SIZE(0), getpid(), 0) == -1) {
             perror("Failed to receive message\n");
             exit(1);
         }
-        if(rcvbuf.msgCode == MSG_BLOCKED){
-            if(msgrcv(msgqid, &rcvbuf, sizeof(MessageBuffer), getpid(), 0) == -1) {
-                perror("Failed to receive message\n");
-                exit(1);
-            }
-            if(rcvbuf.msgCode != MSG_GRANTED){
-                perror("Child process unblocked but msgCode was not MSG_GRANTED");
-                exit(1);
-            }
+        if(rcvbuf.msgCode != MSG_GRANTED && rcvbuf.msgCode != MSG_BLOCKED){
+            perror("Child process received a reply that was neither MSG_GRANTED nor MSG_BLOCKED");
+            exit(1);
         }
+
+        NoteReplyReceived(stats, &rcvbuf, sentAt);
+        ApplyReply(&buf, &rcvbuf);
+    }
+    shmdt(control);
+    if(channels != nullptr){
+        shmdt(channels);
+    }
+    shmdt(doorbell);
+    if(!quiet){
+        printf("%d: Terminating Child\n",getpid());
     }
-    shmdt(shm_clock);
-    printf("%d: Terminating Child\n",getpid());
     return EXIT_SUCCESS;
 }
@@ -0,0 +1,312 @@
+// Reference stream of a simulated user, shared by the user process and oss's in-process users
+// Every user draws from its own xoshiro256** generator, seeded from the run seed (oss -S), its slot and
+// its launch number, so a run's reference streams can be reproduced exactly. Pages are chosen by a
+// locality model (oss -W): uniform, Zipf hot sets, phase-shifting working sets, sequential scans,
+// loops, or a mix of these
+#ifndef WORKLOAD_H
+#define WORKLOAD_H
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/types.h>
+#include "transport.h"
+
+// Constants for simulation behavior
+#define TERMINATION_CHANCE 1  // 0.1% chance to terminate every loop
+#define READ_CHANCE 85        // Default percentage of references that are reads (oss -R)
+#define WORKLOAD_MAX_MODELS 4 // Models a mix can combine
+#define DEFAULT_WORKLOAD "uniform"
+#define DEFAULT_ZIPF_SKEW 1.0
+#define DEFAULT_PHASE_LENGTH 1000 // References before a phase-shifting working set moves
+#define DEFAULT_SCAN_REFERENCES 4 // References a scan makes to each page before moving on
+
+// Locality models
+#define MODEL_UNIFORM 0
+#define MODEL_ZIPF 1
+#define MODEL_PHASE 2
+#define MODEL_SCAN 3
+#define MODEL_LOOP 4
+
+// Structures for a user's pseudo-random number generator (xoshiro256**)
+struct Rng {
+    uint64_t s[4];
+};
+
+// Step of the SplitMix64 generator, used to expand seeds
+inline uint64_t SplitMix64(uint64_t* state){
+    uint64_t z = (*state += 0x9E3779B97F4A7C15ull);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    return z ^ (z >> 31);
+}
+
+// Returns the seed of the user launched launch-th into a slot of a run
+inline uint64_t WorkloadSeed(uint64_t runSeed, int slot, int launch){
+    uint64_t state = runSeed ^ (((uint64_t)(uint32_t)slot << 32) | (uint32_t)launch);
+    return SplitMix64(&state);
+}
+
+inline void RngSeed(Rng* rng, uint64_t seed){
+    for(int i = 0; i < 4; i++){
+        rng->s[i] = SplitMix64(&seed);
+    }
+}
+
+inline uint64_t RngNext(Rng* rng){
+    uint64_t* s = rng->s;
+    uint64_t x = s[1] * 5;
+    uint64_t result = ((x << 7) | (x >> 57)) * 9;
+    uint64_t t = s[1] << 17;
+    s[2] ^= s[0];
+    s[3] ^= s[1];
+    s[1] ^= s[2];
+    s[0] ^= s[3];
+    s[2] ^= t;
+    s[3] = (s[3] << 45) | (s[3] >> 19);
+    return result;
+}
+
+// Returns a number in [0, bound) (multiply-shift; the bias is negligible for the bounds used here)
+inline uint32_t RngBelow(Rng* rng, uint32_t bound){
+    return (uint32_t)(((RngNext(rng) >> 32) * bound) >> 32);
+}
+
+// Returns a number in [0, 1)
+inline double RngUnit(Rng* rng){
+    return (RngNext(rng) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+// Structures for one locality model: its parameters as given to -W (0 picks a default that depends
+// on the address space) and the state it keeps between references
+struct LocalityModel {
+    int type;
+    double skew;     // zipf: exponent
+    int setPages;    // phase: working set size; loop: pages looped over
+    int runLength;   // phase: references per phase; scan: references per page
+    int cursor;      // scan/loop: current page; phase: first page of the working set
+    int left;        // References left before the model moves on
+    double zipfHX1, zipfHN, zipfS; // Constants of the Zipf sampler
+};
+
+// Structures for a workload: the models a user picks between for every reference
+struct WorkloadSpec {
+    int modelCount;
+    LocalityModel models[WORKLOAD_MAX_MODELS];
+};
+
+// Parses a workload such as "zipf:0.8", "phase:16:2000" or "zipf+scan" (a mix picks one of its models
+// at random for each reference); returns false if it is not valid
+inline bool ParseWorkload(const char* arg, WorkloadSpec* spec){
+    char text[256];
+    strncpy(text, arg, sizeof(text) - 1);
+    text[sizeof(text) - 1] = '\0';
+    spec->modelCount = 0;
+    char* save = nullptr;
+    for(char* part = strtok_r(text, "+", &save); part != nullptr; part = strtok_r(nullptr, "+", &save)){
+        if(spec->modelCount == WORKLOAD_MAX_MODELS){
+            return false;
+        }
+        LocalityModel* model = &spec->models[spec->modelCount++];
+        memset(model, 0, sizeof(*model));
+        char* params = strchr(part, ':');
+        if(params != nullptr){
+            *params++ = '\0';
+        }
+        double first = 0, second = 0;
+        int given = (params != nullptr) ? sscanf(params, "%lf:%lf", &first, &second) : 0;
+        if(given < 0 || first < 0 || second < 0){
+            return false;
+        }
+        if(strcmp(part, "uniform") == 0 && given == 0){
+            model->type = MODEL_UNIFORM;
+        } else if(strcmp(part, "zipf") == 0 && given <= 1){
+            model->type = MODEL_ZIPF;
+            model->skew = (given >= 1) ? first : DEFAULT_ZIPF_SKEW;
+            if(model->skew <= 0){
+                return false;
+            }
+        } else if(strcmp(part, "phase") == 0){
+            model->type = MODEL_PHASE;
+            model->setPages = (int)first;
+            model->runLength = (given >= 2) ? (int)second : DEFAULT_PHASE_LENGTH;
+        } else if(strcmp(part, "scan") == 0 && given <= 1){
+            model->type = MODEL_SCAN;
+            model->runLength = (given >= 1) ? (int)first : DEFAULT_SCAN_REFERENCES;
+        } else if(strcmp(part, "loop") == 0 && given <= 1){
+            model->type = MODEL_LOOP;
+            model->setPages = (int)first;
+            model->runLength = 1;
+        } else {
+            return false;
+        }
+    }
+    return spec->modelCount > 0;
+}
+
+// Helpers of the Zipf sampler below
+inline double ZipfHelper1(double x){
+    return (fabs(x) > 1e-8) ? log1p(x) / x : 1 - x * (0.5 - x * (1.0 / 3 - 0.25 * x));
+}
+
+inline double ZipfHelper2(double x){
+    return (fabs(x) > 1e-8) ? expm1(x) / x : 1 + x * 0.5 * (1 + x / 3 * (1 + 0.25 * x));
+}
+
+inline double ZipfH(double x, double skew){
+    return exp(-skew * log(x));
+}
+
+inline double ZipfHIntegral(double x, double skew){
+    double logX = log(x);
+    return ZipfHelper2((1 - skew) * logX) * logX;
+}
+
+inline double ZipfHIntegralInverse(double x, double skew){
+    double t = x * (1 - skew);
+    if(t < -1){
+        t = -1;
+    }
+    return exp(ZipfHelper1(t) * x);
+}
+
+// Draws a rank in [1, n] with probability proportional to rank^-skew, in constant expected time and
+// without a table (rejection-inversion, Hoermann and Derflinger)
+inline int ZipfSample(LocalityModel* model, Rng* rng, int n){
+    while(true){
+        double u = model->zipfHN + RngUnit(rng) * (model->zipfHX1 - model->zipfHN);
+        double x = ZipfHIntegralInverse(u, model->skew);
+        int k = (int)(x + 0.5);
+        if(k < 1){
+            k = 1;
+        } else if(k > n){
+            k = n;
+        }
+        if(k - x <= model->zipfS || u >= ZipfHIntegral(k + 0.5, model->skew) - ZipfH(k, model->skew)){
+            return k;
+        }
+    }
+}
+
+// Resolves a model's defaults for an address space of the given number of pages and resets its state
+inline void PrepareModel(LocalityModel* model, Rng* rng, int pages){
+    if(model->type == MODEL_PHASE && (model->setPages < 1 || model->setPages > pages)){
+        model->setPages = (pages >= 8) ? pages / 8 : 1;
+    }
+    if(model->type == MODEL_LOOP && (model->setPages < 1 || model->setPages > pages)){
+        model->setPages = (pages >= 2) ? pages / 2 : 1;
+    }
+    if(model->runLength < 1){
+        model->runLength = (model->type == MODEL_PHASE) ? DEFAULT_PHASE_LENGTH : 1;
+    }
+    model->cursor = (model->type == MODEL_PHASE) ? (int)RngBelow(rng, pages) : 0;
+    model->left = model->runLength;
+    if(model->type == MODEL_ZIPF){
+        model->zipfHX1 = ZipfHIntegral(1.5, model->skew) - 1;
+        model->zipfHN = ZipfHIntegral(pages + 0.5, model->skew);
+        model->zipfS = 2 - ZipfHIntegralInverse(ZipfHIntegral(2.5, model->skew) - ZipfH(2, model->skew), model->skew);
+    }
+}
+
+// Returns the next page a model references in an address space of the given number of pages
+inline int NextModelPage(LocalityModel* model, Rng* rng, int pages){
+    switch(model->type){
+        case MODEL_ZIPF:
+            return ZipfSample(model, rng, pages) - 1; // Page 0 is the hottest
+        case MODEL_PHASE:
+            if(model->left-- == 0){
+                model->left = model->runLength - 1;
+                model->cursor = (int)RngBelow(rng, pages);
+            }
+            return (model->cursor + (int)RngBelow(rng, model->setPages)) % pages;
+        case MODEL_SCAN:
+        case MODEL_LOOP: {
+            int limit = (model->type == MODEL_SCAN) ? pages : model->setPages;
+            int page = model->cursor;
+            if(--model->left == 0){
+                model->left = model->runLength;
+                model->cursor = (model->cursor + 1 == limit) ? 0 : model->cursor + 1;
+            }
+            return page;
+        }
+        default:
+            return (int)RngBelow(rng, pages);
+    }
+}
+
+// Structures for the state a user keeps between requests
+struct UserState {
+    pid_t pid;
+    int pageSize;
+    int pages;        // Pages in the user's address space
+    int readPercent;
+    bool terminating; // No more references will be generated; the batch is drained and then it exits
+    Rng rng;
+    WorkloadSpec workload; // The user's own copy, since the models keep state
+};
+
+// Prepares an empty batch request addressed to oss
+inline void InitializeUser(UserState* user, MessageBuffer* buf, pid_t pid, long ossAddress, int pageSize, int pages,
+                           const WorkloadSpec* workload, int readPercent, uint64_t seed){
+    user->pid = pid;
+    user->pageSize = pageSize;
+    user->pages = pages;
+    user->readPercent = readPercent;
+    user->terminating = false;
+    RngSeed(&user->rng, seed);
+    user->workload = *workload;
+    for(int m = 0; m < user->workload.modelCount; m++){
+        PrepareModel(&user->workload.models[m], &user->rng, pages);
+    }
+    buf->mtype = ossAddress;
+    buf->sender = pid;
+    buf->msgCode = MSG_BATCH;
+    buf->memoryAddress = 0;
+    buf->blockedIndex = -1;
+    buf->count = 0;
+}
+
+// Tops the batch up with fresh references; anything left over from a blocked reply is resent first
+// Returns true if the user decided to terminate during this call
+inline bool FillBatch(UserState* user, MessageBuffer* buf, int batchSize){
+    while(!user->terminating && buf->count < batchSize){
+        if (TERMINATION_CHANCE > (int)RngBelow(&user->rng, 1001)){
+            user->terminating = true;
+            return true;
+        }
+
+        int model = (user->workload.modelCount > 1) ? (int)RngBelow(&user->rng, user->workload.modelCount) : 0;
+        int pageNumber = NextModelPage(&user->workload.models[model], &user->rng, user->pages);
+        int offset = (int)RngBelow(&user->rng, user->pageSize);
+        buf->references[buf->count].memoryAddress = (pageNumber * user->pageSize) + offset;
+
+        if(user->readPercent > (int)RngBelow(&user->rng, 100)){
+            buf->references[buf->count].msgCode = MSG_READ;
+        } else {
+            buf->references[buf->count].msgCode = MSG_WRITE;
+        }
+        buf->count++;
+    }
+    return false;
+}
+
+// Fast-forwards a user past references it generated before, making exactly the draws generating them
+// made: they do not depend on how the references were split into batches
+inline void SkipReferences(UserState* user, uint64_t count){
+    MessageBuffer scratch;
+    while(count > 0 && !user->terminating){
+        scratch.count = 0;
+        FillBatch(user, &scratch, (count < MAX_BATCH_SIZE) ? (int)count : MAX_BATCH_SIZE);
+        count -= scratch.count;
+    }
+}
+
+// Drops the references a reply granted and keeps the rest for the next batch
+inline void ApplyReply(MessageBuffer* buf, const MessageBuffer* reply){
+    int granted = reply->count;
+    memmove(buf->references, buf->references + granted, (buf->count - granted) * sizeof(MemoryReference));
+    buf->count -= granted;
+}
+
+#endif